@@ -0,0 +1,395 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+// Renderer benchmark suite. Every scenario draws the same frames on every
+// run and prints one line of key=value pairs, so two runs diff line by line:
+//   make clean bench && ./neko_bench > before.txt
+//   make clean bench OPTS=-DNEKO_INSTANCED && ./neko_bench > after.txt
+//   make clean bench SOFT=1 && ./neko_bench
+// Off Windows the bench always draws offscreen through src/headless.c, no
+// window or vsync gets in the way and NEKO_SIZE picks the resolution.
+
+#include <stdio.h>
+
+#include "system.h"
+#include "renderer.h"
+#include "opengl.h"
+#include "timing.h"
+
+// Measured frames, all of them fit in a TimingSeries
+#define FRAMES 200
+// Frames drawn first and not measured, textures and glyphs get created there
+#define WARMUP 10
+
+#if defined(NEKO_SOFT)
+#define LAYOUT "soft"
+#elif defined(NEKO_INSTANCED)
+#define LAYOUT "instanced"
+#elif defined(NEKO_PACKED_VERTEX)
+#define LAYOUT "packed"
+#else
+#define LAYOUT "float"
+#endif
+
+#define MAX_SPRITES 100000
+
+// What the scenario being run draws with, set before calling run
+static struct
+{
+	uint32_t count;
+	uint32_t textures;
+	uint32_t flush_every;
+	int32_t  transform;
+	Image    images[64];
+	Sprite   sprites[MAX_SPRITES];
+	Typeface font;
+	uint32_t lines;
+	StaticBatch batch;
+	bool     moving;
+}
+scene = { 0 };
+
+// Draws frame `f` of a scenario
+typedef void (*DrawFn)(uint32_t f);
+
+// Runs a scenario and prints its line. `quads` is how many it pushes each
+// frame. Frame times go from the end of one frame to the end of the next
+// one, and the time spent in `draw` is what submitting cost the CPU.
+static void run(const char *scenario, const char *variant, uint32_t quads, DrawFn draw) {
+	for (uint32_t f = 0; f < WARMUP; f++) {
+		system_window_should_close();
+		renderer_frame();
+		draw(f);
+		if (renderer_end_frame()) {
+			renderer_swap_buffers();
+		}
+	}
+	glFinish();
+
+	TimingSeries frames = { 0 };
+	double submitting = 0.0;
+	uint32_t draw_calls = 0;
+	uint32_t flushes = 0;
+	uint32_t drawn = 0;
+	double start = system_time();
+	double last = start;
+	for (uint32_t f = 0; f < FRAMES; f++) {
+		system_window_should_close();
+		renderer_frame();
+		double submit_start = system_time();
+		draw(WARMUP + f);
+		submitting += system_time() - submit_start;
+		// Frames the damage tracking skips are never shown
+		if (renderer_end_frame()) {
+			renderer_swap_buffers();
+			drawn++;
+		}
+		if (f == FRAMES - 1) {
+			glFinish();
+		}
+
+		RendererStats stats = renderer_get_stats();
+		draw_calls += stats.draw_calls;
+		for (uint32_t r = 0; r < FLUSH_REASONS; r++) {
+			flushes += stats.flushes[r];
+		}
+		double now = system_time();
+		timing_push(&frames, (float)((now - last) * 1000.0));
+		last = now;
+	}
+	double elapsed = last - start;
+	Timing t = timing_summary(&frames);
+
+	printf("scenario=%s variant=%s layout=%s quads=%u frames=%u fps=%.1f"
+		" frame_p50_ms=%.3f frame_p95_ms=%.3f frame_p99_ms=%.3f quads_per_s=%.0f"
+		" submit_ns_per_quad=%.2f draws_per_frame=%.1f flushes_per_frame=%.1f frames_drawn=%u\n",
+		scenario, variant, LAYOUT, quads, FRAMES, FRAMES / elapsed,
+		t.p50, t.p95, t.p99, (double)quads * FRAMES / elapsed,
+		quads ? submitting * 1e9 / ((double)quads * FRAMES) : 0.0,
+		(double)draw_calls / FRAMES, (double)flushes / FRAMES, drawn);
+	fflush(stdout);
+}
+
+// Untextured quads of changing colors
+static void draw_quads(uint32_t f) {
+	(void)f;
+	vec2 size = system_window_size();
+	for (uint32_t i = 0; i < scene.count; i++) {
+		float x = (float)(i * 7 % (uint32_t)size.x);
+		float y = (float)(i * 13 % (uint32_t)size.y);
+		renderer_set_color((Color){ (i & 1), (i & 2) >> 1, (i & 4) >> 2, 1.f });
+		renderer_push_quad(x, y, x + 8.f, y + 8.f, 0.f, 1.f, 0.f, 1.f);
+	}
+	renderer_set_color(WHITE);
+}
+
+static void bench_quads(uint32_t count) {
+	char variant[16];
+	snprintf(variant, sizeof(variant), "n%u", count);
+	scene.count = count;
+	run("quads", variant, count, draw_quads);
+}
+
+// Sprites cycling through `scene.textures` textures, with more than a
+// batch has slots nearly every sprite forces a flush unless sorted.
+static void draw_textured(uint32_t f) {
+	(void)f;
+	vec2 size = system_window_size();
+	for (uint32_t i = 0; i < scene.count; i++) {
+		float x = (float)(i * 7 % (uint32_t)size.x);
+		float y = (float)(i * 13 % (uint32_t)size.y);
+		renderer_set_image(scene.images[i % scene.textures]);
+		renderer_push_quad(x, y, x + 8.f, y + 8.f, 0.f, 1.f, 0.f, 1.f);
+	}
+}
+
+static void bench_textures(uint32_t count, uint32_t textures, bool sorting) {
+	if (!scene.images[0].id) {
+		for (uint32_t i = 0; i < 64; i++) {
+			scene.images[i] = renderer_mem_image(1, 1, (uint8_t[]){ i * 4, 255 - i * 4, 255, 255 });
+		}
+	}
+	char variant[32];
+	snprintf(variant, sizeof(variant), "%utex_%s", textures, sorting ? "sorted" : "unsorted");
+	scene.count = count;
+	scene.textures = textures;
+	renderer_set_sorting(sorting);
+	run("textures", variant, count, draw_textured);
+	renderer_set_sorting(false);
+}
+
+// Each sprite under its own transform, 0 is none, 1 translates and 2
+// also rotates
+static void draw_transformed(uint32_t f) {
+	(void)f;
+	for (uint32_t i = 0; i < scene.count; i++) {
+		float x = (float)(i % 800);
+		float y = (float)(i % 600);
+		if (scene.transform == 0) {
+			renderer_push_quad(x, y, x + 8.f, y + 8.f, 0.f, 1.f, 0.f, 1.f);
+			continue;
+		}
+		renderer_push_mat4();
+		renderer_translate(x, y);
+		if (scene.transform == 2) {
+			renderer_rotate((float)i * 0.01f);
+		}
+		renderer_push_quad(0.f, 0.f, 8.f, 8.f, 0.f, 1.f, 0.f, 1.f);
+		renderer_pop_mat4();
+	}
+}
+
+static void bench_transform(uint32_t count, int32_t kind) {
+	static const char *names[] = { "identity", "translate", "rotate" };
+	scene.count = count;
+	scene.transform = kind;
+	run("transform", names[kind], count, draw_transformed);
+}
+
+static void fill_sprites(uint32_t count, float spread) {
+	vec2 size = system_window_size();
+	uint32_t w = (uint32_t)(size.x * spread);
+	uint32_t h = (uint32_t)(size.y * spread);
+	for (uint32_t i = 0; i < count; i++) {
+		float x = (float)(spread > 1.f ? i * 7919 % w : i * 7 % w);
+		float y = (float)(spread > 1.f ? i * 104729 % h : i * 13 % h);
+		scene.sprites[i] = (Sprite){ x, y, 8.f, 8.f, 0.f, 0.f, 1.f, 1.f,
+			{ (i & 1), (i & 2) >> 1, (i & 4) >> 2, 1.f } };
+	}
+	scene.count = count;
+}
+
+// Whole arrays through renderer_push_quads, vertices are generated with
+// the instruction set being measured
+static void draw_sprites(uint32_t f) {
+	(void)f;
+	renderer_push_quads(scene.sprites, scene.count);
+}
+
+static void bench_sprites(uint32_t count, SimdLevel level) {
+	static const char *names[] = { "scalar", "sse2", "avx2" };
+	if (renderer_set_simd(level) != level) {
+		printf("scenario=sprites variant=%s layout=%s unsupported\n", names[level], LAYOUT);
+		return;
+	}
+	fill_sprites(count, 1.f);
+	run("sprites", names[level], count, draw_sprites);
+	renderer_set_simd(SIMD_AVX2);
+}
+
+// A world ten screens wide and tall scrolling under the camera, only about
+// one in a hundred sprites is in view at any time.
+static void draw_scrolling(uint32_t f) {
+	renderer_push_mat4();
+	renderer_translate(-(float)f * 20.f, -(float)f * 15.f);
+	renderer_push_quads(scene.sprites, scene.count);
+	renderer_pop_mat4();
+}
+
+static void bench_culling(uint32_t count, bool culling) {
+	fill_sprites(count, 10.f);
+	renderer_set_culling(culling);
+	run("culling", culling ? "culled" : "not_culled", count, draw_scrolling);
+	renderer_set_culling(true);
+}
+
+static void push_tiles(uint32_t count) {
+	vec2 size = system_window_size();
+	uint32_t columns = (uint32_t)size.x / 4;
+	for (uint32_t i = 0; i < count; i++) {
+		float x = (float)(i % columns * 4);
+		float y = (float)(i / columns * 4 % (uint32_t)size.y);
+		renderer_push_quad(x, y, x + 4.f, y + 4.f, 0.f, 1.f, 0.f, 1.f);
+	}
+}
+
+static void draw_tiles(uint32_t f) {
+	(void)f;
+	if (scene.batch.id) {
+		renderer_draw_static(scene.batch);
+	}
+	else {
+		push_tiles(scene.count);
+	}
+}
+
+// A tile layer covering the screen a few times over, pushed every frame
+// or recorded once into a static batch. The tiles are small but cover the
+// screen, on a slow GPU the frame time is all fill rate.
+static void bench_static(uint32_t count, bool retained) {
+	scene.count = count;
+	if (retained) {
+		renderer_begin_static();
+		push_tiles(count);
+		scene.batch = renderer_end_static();
+	}
+	run("static", retained ? "static" : "pushed", count, draw_tiles);
+	if (retained) {
+		renderer_free_static(scene.batch);
+		scene.batch = (StaticBatch){ 0 };
+	}
+}
+
+// The tile layer with a sprite moving over it or not, what damage tracking
+// saves on a mostly still screen. DAMAGE_SKIP only skips frames where
+// nothing moved, DAMAGE_PARTIAL redraws around the sprite.
+static void draw_damage(uint32_t f) {
+	push_tiles(scene.count);
+	if (scene.moving) {
+		float x = (float)(f * 4 % 760);
+		renderer_set_color((Color){ 1.f, 0.f, 0.f, 1.f });
+		renderer_push_quad(x, 280.f, x + 40.f, 320.f, 0.f, 1.f, 0.f, 1.f);
+		renderer_set_color(WHITE);
+	}
+}
+
+static void bench_damage(uint32_t count, DamageMode mode, bool moving) {
+	static const char *names[] = { "off", "skip", "partial" };
+	char variant[32];
+	snprintf(variant, sizeof(variant), "%s_%s", names[mode], moving ? "moving" : "still");
+	scene.count = count;
+	scene.moving = moving;
+	renderer_set_damage(mode);
+	run("damage", variant, count + moving, draw_damage);
+	renderer_set_damage(DAMAGE_OFF);
+}
+
+static const char *text_line = "The quick brown fox jumps over the lazy dog 0123456789";
+
+// Screens full of UI text, every glyph is already in the atlas after the
+// first frame so this is the per glyph cost of laying out and batching.
+static void draw_text(uint32_t f) {
+	(void)f;
+	vec2 size = system_window_size();
+	for (uint32_t i = 0; i < scene.lines; i++) {
+		float y = (float)(i * 16 % (uint32_t)size.y);
+		renderer_draw_text(scene.font, text_line, 0.f, y, 14.f);
+	}
+}
+
+static void bench_text(uint32_t lines) {
+	if (!scene.font.id) {
+		scene.font = renderer_load_font("data/roboto.ttf");
+	}
+	uint32_t glyphs = 0;
+	for (const char *c = text_line; *c; c++) {
+		glyphs += (*c != ' ');
+	}
+	char variant[16];
+	snprintf(variant, sizeof(variant), "lines%u", lines);
+	scene.lines = lines;
+	run("text", variant, lines * glyphs, draw_text);
+}
+
+// Untextured quads with an explicit renderer_flush every few of them, what
+// code that flushes around every state change ends up costing
+static void draw_flushing(uint32_t f) {
+	(void)f;
+	vec2 size = system_window_size();
+	for (uint32_t i = 0; i < scene.count; i++) {
+		float x = (float)(i * 7 % (uint32_t)size.x);
+		float y = (float)(i * 13 % (uint32_t)size.y);
+		renderer_push_quad(x, y, x + 8.f, y + 8.f, 0.f, 1.f, 0.f, 1.f);
+		if ((i + 1) % scene.flush_every == 0) {
+			renderer_flush();
+		}
+	}
+}
+
+static void bench_flushes(uint32_t count, uint32_t every) {
+	char variant[16];
+	snprintf(variant, sizeof(variant), "every%u", every);
+	scene.count = count;
+	scene.flush_every = every;
+	run("flushes", variant, count, draw_flushing);
+}
+
+int entry_point(void) {
+	system_create_window(800, 600, "Neko bench");
+	renderer_init();
+
+	vec2 size = system_window_size();
+	printf("# neko_bench layout=%s size=%dx%d frames=%u warmup=%u renderer=\"%s\"\n", LAYOUT,
+		(int32_t)size.x, (int32_t)size.y, FRAMES, WARMUP, (const char *)glGetString(GL_RENDERER));
+	// Run it twice to see the shader cache, the first run fills it
+	StartupStats startup = renderer_get_startup_stats();
+	printf("scenario=startup variant=%s layout=%s init_ms=%.3f shaders_ms=%.3f"
+		" programs_cached=%u programs_compiled=%u\n",
+		startup.programs_cached ? "cached" : "compiled", LAYOUT, startup.init_ms,
+		startup.shaders_ms, startup.programs_cached, startup.programs_compiled);
+
+	bench_quads(1000);
+	bench_quads(10000);
+	bench_quads(100000);
+
+	bench_textures(10000, 1, false);
+	bench_textures(10000, 64, false);
+	bench_textures(10000, 64, true);
+
+	bench_transform(10000, 0);
+	bench_transform(10000, 1);
+	bench_transform(10000, 2);
+
+	bench_sprites(10000, SIMD_NONE);
+	bench_sprites(10000, SIMD_SSE2);
+	bench_sprites(10000, SIMD_AVX2);
+
+	bench_culling(100000, false);
+	bench_culling(100000, true);
+
+	bench_static(50000, false);
+	bench_static(50000, true);
+
+	bench_text(200);
+
+	bench_flushes(10000, 16);
+	bench_flushes(10000, 256);
+
+	bench_damage(10000, DAMAGE_OFF, true);
+	bench_damage(10000, DAMAGE_SKIP, false);
+	bench_damage(10000, DAMAGE_SKIP, true);
+	bench_damage(10000, DAMAGE_PARTIAL, true);
+
+	return 0;
+}
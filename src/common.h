@@ -25,6 +25,7 @@
 			".balign 1\n" \
 			"incbin_" STR(name) "_end:\n" \
 			".byte 0\n" \
+			".previous\n" \
 	); \
 	extern __attribute__((aligned(16))) const char incbin_ ## name ## _start[]; \
 	extern                              const char incbin_ ## name ## _end[]
@@ -0,0 +1,113 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#include "draw_common.h"
+
+static void classify(TransformStack *t) {
+	mat3x2 m = t->m;
+	if (m.a != 1.f || m.b != 0.f || m.c != 0.f || m.d != 1.f) {
+		t->kind = TRANSFORM_AFFINE;
+	}
+	else if (m.tx != 0.f || m.ty != 0.f) {
+		t->kind = TRANSFORM_TRANSLATE;
+	}
+	else {
+		t->kind = TRANSFORM_IDENTITY;
+	}
+}
+
+void transform_reset(TransformStack *t) {
+	t->m = math_mat3x2_identity();
+	t->kind = TRANSFORM_IDENTITY;
+	t->depth = 0;
+}
+
+void transform_push(TransformStack *t) {
+	assert(t->depth < MAX_TRANSFORMS);
+	t->saved[t->depth++] = t->m;
+}
+
+void transform_pop(TransformStack *t) {
+	assert(t->depth > 0);
+	t->m = t->saved[--t->depth];
+	classify(t);
+}
+
+void transform_translate(TransformStack *t, float x, float y) {
+	mat3x2 *m = &t->m;
+	m->tx += m->a * x + m->c * y;
+	m->ty += m->b * x + m->d * y;
+	if (t->kind == TRANSFORM_IDENTITY) {
+		t->kind = TRANSFORM_TRANSLATE;
+	}
+}
+
+void transform_mul(TransformStack *t, mat3x2 m) {
+	t->m = math_mat3x2_mul(t->m, m);
+	classify(t);
+}
+
+// Stable LSD radix sort over the key bytes above the command index, since
+// the keys come in index order. Bytes every key agrees on are skipped.
+void sort_keys(uint64_t *keys, uint64_t *tmp, uint32_t count) {
+	uint64_t *src = keys;
+	uint64_t *dst = tmp;
+	for (uint32_t shift = 16; shift < 64; shift += 8) {
+		uint32_t offsets[256] = { 0 };
+		for (uint32_t i = 0; i < count; i++) {
+			offsets[(src[i] >> shift) & 0xFF]++;
+		}
+		if (offsets[(src[0] >> shift) & 0xFF] == count) {
+			continue;
+		}
+		for (uint32_t b = 0, sum = 0; b < 256; b++) {
+			uint32_t n = offsets[b];
+			offsets[b] = sum;
+			sum += n;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+		}
+		uint64_t *swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != keys) {
+		memcpy(keys, src, count * sizeof(uint64_t));
+	}
+}
+
+void damage_add(float *damage, const float *b) {
+	damage[0] = b[0] < damage[0] ? b[0] : damage[0];
+	damage[1] = b[1] < damage[1] ? b[1] : damage[1];
+	damage[2] = b[2] > damage[2] ? b[2] : damage[2];
+	damage[3] = b[3] > damage[3] ? b[3] : damage[3];
+}
+
+bool damage_clip(const float *damage, int32_t *rect) {
+	// A pixel of margin for whatever filtering or rounding touches
+	int32_t x0 = (int32_t)floorf(damage[0]) - 1;
+	int32_t y0 = (int32_t)floorf(damage[1]) - 1;
+	int32_t x1 = (int32_t)ceilf(damage[2]) + 1;
+	int32_t y1 = (int32_t)ceilf(damage[3]) + 1;
+	x0 = x0 > rect[0] ? x0 : rect[0];
+	y0 = y0 > rect[1] ? y0 : rect[1];
+	x1 = x1 < rect[2] ? x1 : rect[2];
+	y1 = y1 < rect[3] ? y1 : rect[3];
+	if (x1 <= x0 || y1 <= y0) {
+		x1 = x0 = y1 = y0 = 0;
+	}
+	if (x0 == rect[0] && y0 == rect[1] && x1 == rect[2] && y1 == rect[3]) {
+		return false;
+	}
+	rect[0] = x0;
+	rect[1] = y0;
+	rect[2] = x1;
+	rect[3] = y1;
+	return true;
+}
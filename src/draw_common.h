@@ -0,0 +1,98 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_DRAW_COMMON_H
+#define NEKO_DRAW_COMMON_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "math.h"
+#include "renderer.h"
+
+// What renderer.c and soft.c do the same way before a quad reaches GL or
+// the rasterizer: the transform stack, sorting keys, damage rects and
+// packed colors. No GL in here.
+
+// Depth of the transform stack, every frame starts over from the identity
+#define MAX_TRANSFORMS 32
+
+// What the current transform does, so quads only pay for what it uses
+typedef enum
+{
+	TRANSFORM_IDENTITY,
+	TRANSFORM_TRANSLATE,
+	TRANSFORM_AFFINE,
+}
+TransformKind;
+
+typedef struct
+{
+	mat3x2        m;
+	TransformKind kind;
+	mat3x2        saved[MAX_TRANSFORMS];
+	uint32_t      depth;
+}
+TransformStack;
+
+// Back to the identity with nothing pushed
+void transform_reset(TransformStack *t);
+void transform_push(TransformStack *t);
+void transform_pop(TransformStack *t);
+void transform_translate(TransformStack *t, float x, float y);
+// Applies `m` before the current transform, like the scale and rotate calls
+void transform_mul(TransformStack *t, mat3x2 m);
+
+// Moves a quad given as its first corner and the edges from it to the
+// second and fourth ones, `q` points at x, y, ax, ay, bx, by. Only the
+// corner moves with the translation, the edges are vectors.
+static inline void transform_quad(const TransformStack *t, float *q) {
+	const mat3x2 *m = &t->m;
+	if (t->kind == TRANSFORM_TRANSLATE) {
+		q[0] += m->tx;
+		q[1] += m->ty;
+	}
+	else if (t->kind == TRANSFORM_AFFINE) {
+		float x = q[0], y = q[1], ax = q[2], ay = q[3], bx = q[4], by = q[5];
+		q[0] = m->a * x  + m->c * y + m->tx;
+		q[1] = m->b * x  + m->d * y + m->ty;
+		q[2] = m->a * ax + m->c * ay;
+		q[3] = m->b * ax + m->d * ay;
+		q[4] = m->a * bx + m->c * by;
+		q[5] = m->b * bx + m->d * by;
+	}
+}
+
+// Whether the bounds of a quad, given as for transform_quad, overlap
+// `view`. Quads that only touch its edges cover no pixels.
+static inline bool quad_in_view(const float *q, const float *view) {
+	float x0 = q[0] + (q[2] < 0.f ? q[2] : 0.f) + (q[4] < 0.f ? q[4] : 0.f);
+	float x1 = q[0] + (q[2] > 0.f ? q[2] : 0.f) + (q[4] > 0.f ? q[4] : 0.f);
+	float y0 = q[1] + (q[3] < 0.f ? q[3] : 0.f) + (q[5] < 0.f ? q[5] : 0.f);
+	float y1 = q[1] + (q[3] > 0.f ? q[3] : 0.f) + (q[5] > 0.f ? q[5] : 0.f);
+	return x1 > view[0] && x0 < view[2] && y1 > view[1] && y0 < view[3];
+}
+
+// Stable sort of the keys of recorded quads, the low 16 bits of each key
+// are the index of its command and already in order
+void sort_keys(uint64_t *keys, uint64_t *tmp, uint32_t count);
+
+// Grows `damage` to take in the bounds `b`, both as x0, y0, x1, y1
+void damage_add(float *damage, const float *b);
+// Snaps `damage` out to whole pixels inside `rect`. False when that is all
+// of `rect`, which is then left as it is.
+bool damage_clip(const float *damage, int32_t *rect);
+
+// Color as RGBA8 in memory order, what GL reads as normalized unsigned
+// bytes and what the rasterizer blends with
+static inline uint32_t pack_color(Color c) {
+	float ch[4] = { c.r, c.g, c.b, c.a };
+	uint32_t rgba = 0;
+	for (int32_t i = 0; i < 4; i++) {
+		float f = ch[i] < 0.f ? 0.f : (ch[i] > 1.f ? 1.f : ch[i]);
+		rgba |= (uint32_t)(f * 255.f + .5f) << (i * 8);
+	}
+	return rgba;
+}
+
+#endif
@@ -0,0 +1,201 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "glyphs.h"
+
+void glyph_cache_init(GlyphCache *c, GlyphStore store) {
+	memset(c->buckets, 0xFF, sizeof(c->buckets));
+	c->store = store;
+}
+
+bool glyph_add_font(GlyphCache *c, const uint8_t *data) {
+	FontFace *f = &c->fonts[c->font_count];
+	if (!stbtt_InitFont(&f->info, data, stbtt_GetFontOffsetForIndex(data, 0))) {
+		return false;
+	}
+
+	int32_t ascent, descent, line_gap;
+	stbtt_GetFontVMetrics(&f->info, &ascent, &descent, &line_gap);
+	f->scale = stbtt_ScaleForPixelHeight(&f->info, 1.f);
+	f->ascent = ascent * f->scale;
+	f->line_height = (ascent - descent + line_gap) * f->scale;
+	f->kerning = f->info.kern || f->info.gpos;
+	c->font_count++;
+	return true;
+}
+
+// Looks a glyph up, rasterizing it into a free cell or the least recently
+// used one when it isn't there.
+Glyph *glyph_get(GlyphCache *c, uint32_t font, uint32_t codepoint) {
+	uint32_t bucket = (font * 0x9E3779B1u ^ codepoint * 0x85EBCA6Bu) % GLYPH_BUCKETS;
+	for (int16_t i = c->buckets[bucket]; i >= 0; i = c->glyphs[i].next) {
+		Glyph *g = &c->glyphs[i];
+		if (g->font == font && g->codepoint == codepoint) {
+			g->last_used = ++c->tick;
+			return g;
+		}
+	}
+
+	uint32_t cell = c->count;
+	Glyph *old = NULL;
+	if (cell < GLYPH_CELLS) {
+		c->count++;
+	}
+	else {
+		cell = 0;
+		for (uint32_t i = 1; i < GLYPH_CELLS; i++) {
+			if (c->glyphs[i].last_used < c->glyphs[cell].last_used) {
+				cell = i;
+			}
+		}
+		old = &c->glyphs[cell];
+		uint32_t old_bucket = (old->font * 0x9E3779B1u ^ old->codepoint * 0x85EBCA6Bu) % GLYPH_BUCKETS;
+		int16_t *link = &c->buckets[old_bucket];
+		while (*link != (int16_t)cell) {
+			link = &c->glyphs[*link].next;
+		}
+		*link = old->next;
+	}
+
+	// Glyphs that don't fit a cell are rasterized smaller, they just get blurrier
+	FontFace *f = &c->fonts[font - 1];
+	int32_t index = stbtt_FindGlyphIndex(&f->info, codepoint);
+	float scale = f->scale * GLYPH_SDF_SIZE;
+	int32_t w = 0, h = 0, xoff = 0, yoff = 0;
+	uint8_t *sdf = stbtt_GetGlyphSDF(&f->info, scale, index, GLYPH_PADDING,
+		GLYPH_ON_EDGE, GLYPH_DIST_SCALE, &w, &h, &xoff, &yoff);
+	if (sdf && (w > GLYPH_CELL || h > GLYPH_CELL)) {
+		stbtt_FreeSDF(sdf, NULL);
+		scale *= (float)(GLYPH_CELL - 2 * GLYPH_PADDING) / (float)((w > h ? w : h) - 2 * GLYPH_PADDING);
+		sdf = stbtt_GetGlyphSDF(&f->info, scale, index, GLYPH_PADDING,
+			GLYPH_ON_EDGE, GLYPH_DIST_SCALE, &w, &h, &xoff, &yoff);
+	}
+	w = w < GLYPH_CELL ? w : GLYPH_CELL;
+	h = h < GLYPH_CELL ? h : GLYPH_CELL;
+
+	// The whole cell is stored so nothing from its last glyph bleeds in
+	int32_t cx = (cell % GLYPH_COLUMNS) * GLYPH_CELL;
+	int32_t cy = (cell / GLYPH_COLUMNS) * GLYPH_CELL;
+	if (sdf) {
+		uint8_t texels[GLYPH_CELL * GLYPH_CELL] = { 0 };
+		for (int32_t row = 0; row < h; row++) {
+			memcpy(texels + row * GLYPH_CELL, sdf + row * w, w);
+		}
+		stbtt_FreeSDF(sdf, NULL);
+		c->store(cx, cy, texels, old);
+	}
+	else {
+		w = h = 0;
+		c->store(cx, cy, NULL, old);
+	}
+
+	int32_t advance, bearing;
+	stbtt_GetGlyphHMetrics(&f->info, index, &advance, &bearing);
+	float unit = f->scale / scale;
+	Glyph *g = &c->glyphs[cell];
+	*g = (Glyph){
+		.font = font, .codepoint = codepoint, .index = index,
+		.last_used = ++c->tick, .next = c->buckets[bucket],
+		.x0 = xoff * unit, .y0 = yoff * unit, .w = w * unit, .h = h * unit,
+		.advance = advance * f->scale,
+		.u0 = (float)cx / GLYPH_ATLAS_SIZE, .v0 = (float)cy / GLYPH_ATLAS_SIZE,
+		.u1 = (float)(cx + w) / GLYPH_ATLAS_SIZE, .v1 = (float)(cy + h) / GLYPH_ATLAS_SIZE };
+	c->buckets[bucket] = cell;
+	return g;
+}
+
+// Kerning between two glyphs for text 1 pixel tall
+float glyph_kerning(GlyphCache *c, uint32_t font, int32_t left, int32_t right) {
+	uint32_t pair = (uint32_t)left << 16 | (uint32_t)right;
+	KerningPair *k = &c->kerning[((pair ^ font << 28) * 0x9E3779B1u) >> (32 - KERNING_BITS)];
+	if (k->font != font || k->pair != pair) {
+		FontFace *f = &c->fonts[font - 1];
+		*k = (KerningPair){ font, pair, stbtt_GetGlyphKernAdvance(&f->info, left, right) * f->scale };
+	}
+	return k->advance;
+}
+
+// Lays text out into `scratch` and returns how many glyphs it has. Lines
+// longer than `width` break after their last space, 0 never breaks them.
+uint32_t glyph_layout(GlyphCache *c, uint32_t font, const char *text, float size, float width) {
+	FontFace *f = &c->fonts[font - 1];
+	float line_height = f->line_height * size;
+	float pen_x = 0.f;
+	float pen_y = f->ascent * size;
+	int32_t prev = 0;
+	uint32_t count = 0;
+	// Glyphs from `wrap_from` on move to the next line when it breaks
+	uint32_t wrap_from = 0;
+	float wrap_x = 0.f;
+
+	const uint8_t *p = (const uint8_t*)text;
+	while (*p) {
+		// Decode UTF-8, malformed bytes come out as they are
+		uint32_t cp = *p++;
+		if (cp >= 0xC0) {
+			int32_t extra = cp >= 0xF0 ? 3 : (cp >= 0xE0 ? 2 : 1);
+			cp &= 0x3F >> extra;
+			for (; extra > 0 && (*p & 0xC0) == 0x80; extra--) {
+				cp = (cp << 6) | (*p++ & 0x3F);
+			}
+		}
+		if (cp == '\n') {
+			pen_x = 0.f;
+			pen_y += line_height;
+			prev = 0;
+			wrap_x = 0.f;
+			continue;
+		}
+
+		Glyph *g = glyph_get(c, font, cp);
+		if (prev && f->kerning) {
+			pen_x += glyph_kerning(c, font, prev, g->index) * size;
+		}
+		prev = g->index;
+		if (g->w > 0.f) {
+			float x0 = pen_x + g->x0 * size;
+			if (width > 0.f && wrap_x > 0.f && x0 + g->w * size > width) {
+				for (uint32_t i = wrap_from; i < count; i++) {
+					c->scratch[i].x -= wrap_x;
+					c->scratch[i].y += line_height;
+				}
+				pen_x -= wrap_x;
+				pen_y += line_height;
+				x0 -= wrap_x;
+				wrap_x = 0.f;
+			}
+			if (count == c->scratch_size) {
+				c->scratch_size = c->scratch_size ? c->scratch_size * 2 : 256;
+				c->scratch = realloc(c->scratch, c->scratch_size * sizeof(LaidGlyph));
+			}
+			c->scratch[count++] = (LaidGlyph){
+				x0, pen_y + g->y0 * size, g->w * size, g->h * size,
+				cp, (uint16_t)(g - c->glyphs) };
+		}
+		pen_x += g->advance * size;
+		if (cp == ' ') {
+			wrap_from = count;
+			wrap_x = pen_x;
+		}
+	}
+	return count;
+}
+
+// The glyph a laid out one stands for, looked up again only when its cell
+// went to another glyph
+Glyph *glyph_resolve(GlyphCache *c, uint32_t font, LaidGlyph *lg) {
+	Glyph *g = &c->glyphs[lg->cell];
+	if (g->font != font || g->codepoint != lg->codepoint) {
+		g = glyph_get(c, font, lg->codepoint);
+		lg->cell = (uint16_t)(g - c->glyphs);
+	}
+	else {
+		g->last_used = ++c->tick;
+	}
+	return g;
+}
@@ -0,0 +1,111 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_GLYPHS_H
+#define NEKO_GLYPHS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "stb/stb_truetype.h"
+
+// Glyphs are rasterized once as signed distance fields GLYPH_SDF_SIZE pixels
+// tall, and scaled to whatever size the text is drawn at. They live in a
+// grid of fixed cells of a single channel texture, when every cell is taken
+// the least recently used glyph gives its cell up.
+#define GLYPH_ATLAS_SIZE 1024
+#define GLYPH_CELL       48
+#define GLYPH_COLUMNS    (GLYPH_ATLAS_SIZE / GLYPH_CELL)
+#define GLYPH_CELLS      (GLYPH_COLUMNS * GLYPH_COLUMNS)
+#define GLYPH_BUCKETS    1024
+#define GLYPH_SDF_SIZE   32
+#define GLYPH_PADDING    4
+// Distance field value on the outline and how much it changes per texel,
+// general_fs.glsl and the software rasterizer decode it with the same numbers.
+#define GLYPH_ON_EDGE    128
+#define GLYPH_DIST_SCALE 24.f
+#define MAX_FONTS        8
+// Kerning lookups walk the font tables, so the pairs seen get cached
+#define KERNING_BITS     12
+#define KERNING_CACHE    (1 << KERNING_BITS)
+
+typedef struct
+{
+	stbtt_fontinfo info;
+	// Font units to pixels for text 1 pixel tall, and its vertical metrics
+	float          scale;
+	float          ascent;
+	float          line_height;
+	bool           kerning;
+}
+FontFace;
+
+typedef struct
+{
+	uint32_t font;
+	uint32_t codepoint;
+	uint32_t last_used;
+	int32_t  index;
+	int16_t  next;
+	// Quad from the pen on the baseline for text 1 pixel tall
+	float    x0, y0, w, h;
+	float    advance;
+	float    u0, v0, u1, v1;
+}
+Glyph;
+
+typedef struct
+{
+	uint32_t font;
+	uint32_t pair;
+	float    advance;
+}
+KerningPair;
+
+typedef struct
+{
+	// Quad from the top left corner of the text
+	float    x, y, w, h;
+	// The atlas cell is checked before every draw, as the glyph may have
+	// been evicted and rasterized again somewhere else since
+	uint32_t codepoint;
+	uint16_t cell;
+}
+LaidGlyph;
+
+// Puts a rasterized cell, GLYPH_CELL texels square, into the atlas at x, y.
+// `texels` is NULL for glyphs with nothing to draw. `old` is the glyph that
+// had the cell, still as it was, or NULL when the cell was free.
+typedef void (*GlyphStore)(int32_t x, int32_t y, const uint8_t *texels, const Glyph *old);
+
+// Fonts, the glyphs in the atlas and the text layout scratch. Only the
+// texture is left to the renderer, through `store`.
+typedef struct
+{
+	FontFace    fonts[MAX_FONTS];
+	uint32_t    font_count;
+	Glyph       glyphs[GLYPH_CELLS];
+	int16_t     buckets[GLYPH_BUCKETS];
+	uint32_t    count;
+	// Glyphs used after the last flush may still be sampled by pending quads
+	uint32_t    tick;
+	uint32_t    flushed;
+	KerningPair kerning[KERNING_CACHE];
+	// Where text is laid out, grows as needed
+	LaidGlyph  *scratch;
+	uint32_t    scratch_size;
+	GlyphStore  store;
+}
+GlyphCache;
+
+void glyph_cache_init(GlyphCache *c, GlyphStore store);
+// False when `data` isn't a font. stb_truetype reads from it for as long as
+// the font lives, the font id is the new font_count.
+bool glyph_add_font(GlyphCache *c, const uint8_t *data);
+Glyph *glyph_get(GlyphCache *c, uint32_t font, uint32_t codepoint);
+float glyph_kerning(GlyphCache *c, uint32_t font, int32_t left, int32_t right);
+uint32_t glyph_layout(GlyphCache *c, uint32_t font, const char *text, float size, float width);
+Glyph *glyph_resolve(GlyphCache *c, uint32_t font, LaidGlyph *lg);
+
+#endif
@@ -0,0 +1,233 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+// Backend without a window, for benchmarks and automated runs on machines
+// with no display and no GPU: `make HEADLESS=1`, Mesa's llvmpipe is enough.
+// Frames are drawn into an EGL pbuffer, so framebuffer 0 is still what the
+// renderer draws to. Runs are set up from the environment:
+//   NEKO_SIZE=1920x1080    resolution instead of the one asked for
+//   NEKO_FRAMES=300        close after that many frames, 0 never closes
+//   NEKO_CAPTURE=out.ppm   save the last frame when closing
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "system.h"
+#include "opengl.h"
+#include "posix.h"
+#include "trace.h"
+
+#define X(type, name) type name;
+GL_FUNCTIONS(X)
+GL_OPTIONAL_FUNCTIONS(X)
+#undef X
+
+static struct {
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext gl_context;
+    bool should_close;
+    int width, height;
+    uint32_t frames;
+    uint32_t max_frames;
+    const char *capture;
+    // Set by system_set_framebuffer, captured instead of framebuffer 0
+    const uint8_t *framebuffer;
+} self = {0};
+
+static void load_gl_functions(void) {
+#define X(type, name) \
+    name = (type)eglGetProcAddress(#name); \
+    if (!name) { \
+        fprintf(stderr, "Failed to load OpenGL function: %s\n", #name); \
+        system_panic("Failed to load required OpenGL functions"); \
+    }
+    GL_FUNCTIONS(X)
+#undef X
+
+#define X(type, name) name = (type)eglGetProcAddress(#name);
+    GL_OPTIONAL_FUNCTIONS(X)
+#undef X
+
+#ifdef GL_DEBUG
+    if (glDebugMessageCallback) {
+        glDebugMessageCallback(&posix_debug_callback, NULL);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+#endif
+}
+
+// Prefers Mesa's surfaceless platform, which needs neither X11 nor a GPU
+static EGLDisplay open_display(void) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL)) {
+            return display;
+        }
+    }
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        system_panic("Failed to open an EGL display");
+    }
+    return display;
+}
+
+void system_create_window(int32_t width, int32_t height, const char *name) {
+    assert(self.display == NULL && "Window already created");
+    (void)name;
+
+    const char *size = getenv("NEKO_SIZE");
+    if (size && (sscanf(size, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        system_panic("NEKO_SIZE should look like 1280x720");
+    }
+    const char *frames = getenv("NEKO_FRAMES");
+    self.max_frames = frames ? (uint32_t)strtoul(frames, NULL, 10) : 0;
+    self.capture = getenv("NEKO_CAPTURE");
+    self.width = width;
+    self.height = height;
+
+    self.display = open_display();
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        system_panic("EGL has no desktop OpenGL");
+    }
+
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE,        8,
+        EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,       8,
+        EGL_ALPHA_SIZE,      8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint count = 0;
+    if (!eglChooseConfig(self.display, config_attribs, &config, 1, &count) || count == 0) {
+        system_panic("Failed to retrieve framebuffer config");
+    }
+
+    EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    self.surface = eglCreatePbufferSurface(self.display, config, surface_attribs);
+    if (self.surface == EGL_NO_SURFACE) {
+        system_panic("Failed to create the offscreen surface");
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, GL_MAJOR,
+        EGL_CONTEXT_MINOR_VERSION, GL_MINOR,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef GL_DEBUG
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    self.gl_context = eglCreateContext(self.display, config, EGL_NO_CONTEXT, context_attribs);
+    if (self.gl_context == EGL_NO_CONTEXT) {
+        system_panic("Failed to create OpenGL context");
+    }
+    if (!eglMakeCurrent(self.display, self.surface, self.surface, self.gl_context)) {
+        system_panic("Failed to make OpenGL context current");
+    }
+
+    load_gl_functions();
+    self.should_close = false;
+}
+
+// Writes the frame shown as a binary PPM
+static void capture_frame(const char *filename) {
+    uint32_t pitch = self.width * 4;
+    uint8_t *pixels = NULL;
+    const uint8_t *rows = self.framebuffer;
+    if (!rows) {
+        // GL reads bottom row first
+        uint8_t *flipped = malloc((size_t)pitch * self.height);
+        pixels = malloc((size_t)pitch * self.height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glReadPixels(0, 0, self.width, self.height, GL_RGBA, GL_UNSIGNED_BYTE, flipped);
+        for (int y = 0; y < self.height; y++) {
+            memcpy(pixels + y * pitch, flipped + (self.height - 1 - y) * pitch, pitch);
+        }
+        free(flipped);
+        rows = pixels;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        system_panic("Couldn't create the capture file");
+    }
+    fprintf(file, "P6\n%d %d\n255\n", self.width, self.height);
+    for (int i = 0; i < self.width * self.height; i++) {
+        fwrite(rows + i * 4, 1, 3, file);
+    }
+    fclose(file);
+    free(pixels);
+}
+
+bool system_window_should_close() {
+    if (!self.display) return true;
+
+    // Called once per frame by the main loop, which is what frames count
+    TRACE_BEGIN("system_window_should_close");
+    if (!self.should_close && self.max_frames && ++self.frames > self.max_frames) {
+        self.should_close = true;
+        if (self.capture) {
+            capture_frame(self.capture);
+        }
+    }
+    TRACE_END();
+    return self.should_close;
+}
+
+vec2 system_window_size() {
+    return (vec2){ .x = (float)self.width, .y = (float)self.height };
+}
+
+bool system_window_is_visible() {
+    return !self.should_close;
+}
+
+// Nothing ever covers the pbuffer
+bool system_window_damaged() {
+    return false;
+}
+
+void system_swap_buffers() {
+    // Pbuffers have a single buffer, this only makes sure the frame is done
+    TRACE_BEGIN("system_swap_buffers");
+    if (self.display && self.surface) {
+        eglSwapBuffers(self.display, self.surface);
+    }
+    TRACE_END();
+}
+
+void system_set_framebuffer(const uint8_t *pixels, int32_t width, int32_t height) {
+    // The frame always matches the surface, see system_window_size
+    (void)width;
+    (void)height;
+    self.framebuffer = pixels;
+}
+
+void system_close_window() {
+    if (self.display) {
+        eglMakeCurrent(self.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (self.gl_context != EGL_NO_CONTEXT) {
+            eglDestroyContext(self.display, self.gl_context);
+        }
+        if (self.surface != EGL_NO_SURFACE) {
+            eglDestroySurface(self.display, self.surface);
+        }
+        eglTerminate(self.display);
+        self.display = NULL;
+    }
+    self.surface = EGL_NO_SURFACE;
+    self.gl_context = EGL_NO_CONTEXT;
+    self.should_close = true;
+}
@@ -2,24 +2,40 @@
 // Use of this source code is governed by a MIT
 // license that can be found in the LICENSE file.
 
+#include <stdlib.h>
+
 #include "system.h"
 #include "renderer.h"
+#include "trace.h"
 
 int entry_point ( void ) {
+	TRACE_THREAD("main");
 	system_create_window(800, 600, "Neko");
 	renderer_init();
+	// Assets come out of a pack built by `make pack` only when asked, e.g.
+	// `NEKO_PACK=data.pack ./neko`, so edits to data/ show up without it
+	const char *pack = getenv("NEKO_PACK");
+	if (pack && !renderer_mount_pack(pack)) {
+		system_panic("Couldn't mount NEKO_PACK");
+	}
 
 	while (!system_window_should_close()) {
 		if (system_window_is_visible()) {
 			renderer_frame();
 			renderer_set_color((Color){ 1, 0, 0, 1 });
 			renderer_push_quad(0.f, 0.f, 250.f, 250.f, 0.f, 1.f, 0.f, 1.f);
-			renderer_flush();
-			system_swap_buffers();
+			if (renderer_end_frame()) {
+				renderer_swap_buffers();
+			}
+			else {
+				system_sleep(1);
+			}
 		}
 		else {
 			system_sleep(1);
 		}
 	}
+	// Built with `make OPTS=-DNEKO_TRACE`, open it in ui.perfetto.dev
+	TRACE_DUMP("trace.json");
 	return 0;
 }
\ No newline at end of file
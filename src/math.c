@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 // I just stole those functions from Ray
 
+#include <math.h>
 #include "math.h"
 
 mat4 math_mat4_identity() {
@@ -84,4 +85,59 @@ mat4 math_mat4_transpose(mat4 m) {
 	result.m15 = m.m15;
 
 	return result;
-}
\ No newline at end of file
+}
+
+mat4 math_mat4_from_mat3x2(mat3x2 m) {
+	mat4 result = math_mat4_identity();
+	result.m0  = m.a;
+	result.m1  = m.b;
+	result.m4  = m.c;
+	result.m5  = m.d;
+	result.m12 = m.tx;
+	result.m13 = m.ty;
+	return result;
+}
+
+mat3x2 math_mat3x2_identity() {
+	return (mat3x2){
+		1.0f, 0.0f,
+		0.0f, 1.0f,
+		0.0f, 0.0f };
+}
+
+// Applies `n` first and then `m`
+mat3x2 math_mat3x2_mul(mat3x2 m, mat3x2 n) {
+	mat3x2 result = { 0 };
+
+	result.a  = m.a*n.a  + m.c*n.b;
+	result.b  = m.b*n.a  + m.d*n.b;
+	result.c  = m.a*n.c  + m.c*n.d;
+	result.d  = m.b*n.c  + m.d*n.d;
+	result.tx = m.a*n.tx + m.c*n.ty + m.tx;
+	result.ty = m.b*n.tx + m.d*n.ty + m.ty;
+
+	return result;
+}
+
+mat3x2 math_mat3x2_translate(float x, float y) {
+	return (mat3x2){
+		1.0f, 0.0f,
+		0.0f, 1.0f,
+		x, y };
+}
+
+mat3x2 math_mat3x2_scale(float sx, float sy) {
+	return (mat3x2){
+		sx, 0.0f,
+		0.0f, sy,
+		0.0f, 0.0f };
+}
+
+mat3x2 math_mat3x2_rotate(float r) {
+	float c = cosf(r);
+	float s = sinf(r);
+	return (mat3x2){
+		c, s,
+		-s, c,
+		0.0f, 0.0f };
+}
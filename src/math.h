@@ -22,9 +22,25 @@ typedef struct
 }
 mat4;
 
+// 2D affine transform, a point goes to (a*x + c*y + tx, b*x + d*y + ty)
+typedef struct
+{
+	float a, b;
+	float c, d;
+	float tx, ty;
+}
+mat3x2;
+
 mat4 math_mat4_mul(mat4 a, mat4 b);
 mat4 math_mat4_identity();
 mat4 math_mat4_ortho(float left, float right, float bottom, float top, float near, float far);
 mat4 math_mat4_transpose(mat4 m);
+mat4 math_mat4_from_mat3x2(mat3x2 m);
+
+mat3x2 math_mat3x2_identity();
+mat3x2 math_mat3x2_mul(mat3x2 m, mat3x2 n);
+mat3x2 math_mat3x2_translate(float x, float y);
+mat3x2 math_mat3x2_scale(float sx, float sy);
+mat3x2 math_mat3x2_rotate(float r);
 
 #endif
\ No newline at end of file
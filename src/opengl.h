@@ -14,6 +14,10 @@
 #define GL_MINOR 3
 
 #if defined(__linux__) || defined(__unix__)
+// We declare our own GL types and entry points below, so keep the system
+// headers from pulling glext.h/glxext.h in and clashing with them.
+#define GL_GLEXT_LEGACY
+#define GLX_GLXEXT_LEGACY
 #include <GL/glx.h>
 
 // GLX extension constants
@@ -67,10 +71,17 @@ static PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT = NULL;
 #define GL_TRUE 1
 #define GL_FLOAT 0x1406
 #define GL_UNSIGNED_BYTE 0x1401
+#define GL_UNSIGNED_SHORT 0x1403
 #define GL_ALPHA 0x1906
 #define GL_RGBA 0x1908
 #define GL_RGBA8 0x8058
 #define GL_RED 0x1903
+#define GL_R8 0x8229
+#define GL_RG 0x8227
+#define GL_RG8 0x822B
+#define GL_GREEN 0x1904
+#define GL_SRGB8_ALPHA8 0x8C43
+#define GL_UNPACK_ALIGNMENT 0x0CF5
 #define GL_DEPTH_BUFFER_BIT 0x00000100
 #define GL_DEPTH_TEST 0x0B71
 #define GL_COLOR_BUFFER_BIT 0x00004000
@@ -81,15 +92,31 @@ static PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT = NULL;
 #define GL_TEXTURE_MAG_FILTER 0x2800
 #define GL_TEXTURE_WRAP_S 0x2802
 #define GL_REPEAT 0x2901
+#define GL_CLAMP_TO_EDGE 0x812F
+#define GL_MIRRORED_REPEAT 0x8370
 #define GL_TEXTURE_WRAP_T 0x2803
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#define GL_TEXTURE_SWIZZLE_RGBA 0x8E46
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
 #define GL_BLEND 0x0BE2
+#define GL_SCISSOR_TEST 0x0C11
+#define GL_ZERO 0
+#define GL_ONE 1
 #define GL_SRC_ALPHA 0x0302
 #define GL_ONE_MINUS_SRC_ALPHA 0x0303
+#define GL_DST_COLOR 0x0306
 #define GL_TRIANGLES 0x0004
+#define GL_TRIANGLE_STRIP 0x0005
 #define GL_LINK_STATUS 0x8B82
 #define GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
 #define GL_DEBUG_SEVERITY_HIGH 0x9146
 #define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#define GL_VENDOR 0x1F00
+#define GL_RENDERER 0x1F01
 #define GL_VERSION 0x1F02
 #define GL_COMPILE_STATUS 0x8B81
 #define GL_ARRAY_BUFFER 0x8892
@@ -97,9 +124,43 @@ static PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT = NULL;
 #define GL_ELEMENT_ARRAY_BUFFER 0x8893
 #define GL_UNSIGNED_INT 0x1405
 #define GL_DYNAMIC_DRAW 0x88E8
+#define GL_STREAM_DRAW 0x88E0
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
 #define GL_LINEAR 0x2601
 #define GL_NEAREST 0x2600
+#define GL_LINEAR_MIPMAP_LINEAR 0x2703
+#define GL_NEAREST_MIPMAP_NEAREST 0x2700
 #define GL_ARRAY_BUFFER_BINDING 0x8894
+#define GL_TEXTURE0 0x84C0
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#define GL_MAX_TEXTURE_IMAGE_UNITS 0x8872
+#define GL_EXTENSIONS 0x1F03
+#define GL_NUM_EXTENSIONS 0x821D
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+#define GL_TIMESTAMP 0x8E28
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
 
 // OpenGL type definitions
 typedef uint32_t GLenum;
@@ -114,6 +175,8 @@ typedef uintptr_t GLsizeiptr;
 typedef uintptr_t GLintptr;
 typedef float GLfloat;
 typedef uint8_t GLubyte;
+typedef uint64_t GLuint64;
+typedef struct __GLsync *GLsync;
 
 // OpenGL 1.0 functions (available through system OpenGL)
 void glEnable(GLenum cap);
@@ -122,15 +185,23 @@ void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
 void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
 void glClear(GLbitfield mask);
 void glDisable(GLenum cap);
+void glScissor(GLint x, GLint y, GLsizei width, GLsizei height);
 void glBindTexture(GLenum target, GLuint texture);
 void glDrawArrays(GLenum mode, GLint first, GLsizei count);
 const GLubyte *glGetString(GLenum name);
 void glActiveTexture(GLenum texture);
+void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data);
 void glTexParameteri(GLenum target, GLenum pname, GLint param);
+void glTexParameteriv(GLenum target, GLenum pname, const GLint *params);
 void glGenTextures(GLsizei n, GLuint *textures);
 void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels);
 void glDeleteTextures(GLsizei n, const GLuint *textures);
 void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+void glGetIntegerv(GLenum pname, GLint *data);
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+void glFinish(void);
+void glPixelStorei(GLenum pname, GLint param);
+void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels);
 
 // OpenGL 3.3+ function pointer types
 typedef void (*PFNGLBINDVERTEXARRAYPROC)(GLuint array);
@@ -151,14 +222,44 @@ typedef void (*PFNGLDELETEPROGRAMPROC)(GLuint program);
 typedef void (*PFNGLBINDBUFFERPROC)(GLenum target, GLuint buffer);
 typedef void (*PFNGLBUFFERDATAPROC)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
 typedef void (*PFNGLGENBUFFERSPROC)(GLsizei n, GLuint* buffers);
+typedef void (*PFNGLDELETEBUFFERSPROC)(GLsizei n, const GLuint* buffers);
 typedef void (*PFNGLVERTEXATTRIBPOINTERPROC)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
 typedef void (*PFNGLENABLEVERTEXATTRIBARRAYPROC)(GLuint index);
 typedef void (*PFNGLUSEPROGRAMPROC)(GLuint program);
 typedef void (*PFNGLBUFFERSUBDATAPROC)(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
 typedef void (*PFNGLGENERATEMIPMAPPROC)(GLenum target);
 typedef void (*PFNGLGENVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
+typedef void (*PFNGLDELETEVERTEXARRAYSPROC)(GLsizei n, const GLuint* arrays);
 typedef void (*PFNGLUNIFORMMATRIX4FVPROC)(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
 typedef GLint (*PFNGLGETUNIFORMLOCATIONPROC)(GLuint program, const GLchar* name);
+typedef void* (*PFNGLMAPBUFFERRANGEPROC)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (*PFNGLUNMAPBUFFERPROC)(GLenum target);
+typedef GLsync (*PFNGLFENCESYNCPROC)(GLenum condition, GLbitfield flags);
+typedef GLenum (*PFNGLCLIENTWAITSYNCPROC)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (*PFNGLDELETESYNCPROC)(GLsync sync);
+typedef const GLubyte* (*PFNGLGETSTRINGIPROC)(GLenum name, GLuint index);
+typedef void (*PFNGLDRAWELEMENTSBASEVERTEXPROC)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint basevertex);
+typedef void (*PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+typedef void (*PFNGLDRAWARRAYSINSTANCEDPROC)(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+typedef void (*PFNGLVERTEXATTRIBIPOINTERPROC)(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer);
+typedef void (*PFNGLUNIFORM1IVPROC)(GLint location, GLsizei count, const GLint* value);
+typedef void (*PFNGLUNIFORM1IPROC)(GLint location, GLint v0);
+typedef void (*PFNGLGENFRAMEBUFFERSPROC)(GLsizei n, GLuint* framebuffers);
+typedef void (*PFNGLDELETEFRAMEBUFFERSPROC)(GLsizei n, const GLuint* framebuffers);
+typedef void (*PFNGLBINDFRAMEBUFFERPROC)(GLenum target, GLuint framebuffer);
+typedef void (*PFNGLFRAMEBUFFERTEXTURE2DPROC)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (*PFNGLCHECKFRAMEBUFFERSTATUSPROC)(GLenum target);
+typedef void (*PFNGLBLENDFUNCSEPARATEPROC)(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha);
+typedef void (*PFNGLBLITFRAMEBUFFERPROC)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+typedef void (*PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (*PFNGLGENQUERIESPROC)(GLsizei n, GLuint* ids);
+typedef void (*PFNGLQUERYCOUNTERPROC)(GLuint id, GLenum target);
+typedef void (*PFNGLGETQUERYOBJECTIVPROC)(GLuint id, GLenum pname, GLint* params);
+typedef void (*PFNGLGETQUERYOBJECTUI64VPROC)(GLuint id, GLenum pname, GLuint64* params);
+typedef void (*PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (*PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (*PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (*PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
 
 // Macro to define all OpenGL function pointers
 #define GL_FUNCTIONS(X) \
@@ -180,18 +281,53 @@ typedef GLint (*PFNGLGETUNIFORMLOCATIONPROC)(GLuint program, const GLchar* name)
 	X(PFNGLBINDBUFFERPROC, glBindBuffer) \
 	X(PFNGLBUFFERDATAPROC, glBufferData) \
 	X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+	X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
 	X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
 	X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
 	X(PFNGLUSEPROGRAMPROC, glUseProgram) \
 	X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
 	X(PFNGLGENERATEMIPMAPPROC, glGenerateMipmap) \
 	X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+	X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays) \
 	X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv) \
-	X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation)
+	X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+	X(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange) \
+	X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer) \
+	X(PFNGLFENCESYNCPROC, glFenceSync) \
+	X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync) \
+	X(PFNGLDELETESYNCPROC, glDeleteSync) \
+	X(PFNGLGETSTRINGIPROC, glGetStringi) \
+	X(PFNGLDRAWELEMENTSBASEVERTEXPROC, glDrawElementsBaseVertex) \
+	X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+	X(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced) \
+	X(PFNGLVERTEXATTRIBIPOINTERPROC, glVertexAttribIPointer) \
+	X(PFNGLUNIFORM1IVPROC, glUniform1iv) \
+	X(PFNGLUNIFORM1IPROC, glUniform1i) \
+	X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers) \
+	X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers) \
+	X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+	X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D) \
+	X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus) \
+	X(PFNGLBLITFRAMEBUFFERPROC, glBlitFramebuffer) \
+	X(PFNGLBLENDFUNCSEPARATEPROC, glBlendFuncSeparate) \
+	X(PFNGLGENQUERIESPROC, glGenQueries) \
+	X(PFNGLQUERYCOUNTERPROC, glQueryCounter) \
+	X(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv) \
+	X(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v)
+
+// Functions above GL 3.3 that we use when the driver has them; these are
+// left NULL instead of failing the load.
+#define GL_OPTIONAL_FUNCTIONS(X) \
+	X(PFNGLBUFFERSTORAGEPROC, glBufferStorage) \
+	X(PFNGLTEXSTORAGE2DPROC, glTexStorage2D) \
+	X(PFNGLGETPROGRAMBINARYPROC, glGetProgramBinary) \
+	X(PFNGLPROGRAMBINARYPROC, glProgramBinary) \
+	X(PFNGLPROGRAMPARAMETERIPROC, glProgramParameteri)
 
 // Declare all OpenGL function pointers
 #define X(type, name) extern type name;
 GL_FUNCTIONS(X)
+GL_OPTIONAL_FUNCTIONS(X)
 #undef X
 
 #endif
\ No newline at end of file
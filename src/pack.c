@@ -0,0 +1,57 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <string.h>
+
+#include "pack.h"
+
+bool pack_open(Pack *p, const void *data, size_t size) {
+	*p = (Pack){ 0 };
+	const PackHeader *h = data;
+	if (size < sizeof(PackHeader) || h->magic != PACK_MAGIC || h->version != PACK_VERSION) {
+		return false;
+	}
+	if (h->count > (size - sizeof(PackHeader)) / sizeof(PackEntry)) {
+		return false;
+	}
+
+	const PackEntry *entries = (const PackEntry *)(h + 1);
+	for (uint32_t i = 0; i < h->count; i++) {
+		const PackEntry *e = &entries[i];
+		if (e->offset > size || e->size > size - e->offset || memchr(e->name, 0, PACK_NAME) == NULL) {
+			return false;
+		}
+		// pack_find does a binary search, out of order names would just miss
+		if (i > 0 && strcmp(entries[i - 1].name, e->name) >= 0) {
+			return false;
+		}
+		if (e->kind == PACK_PIXELS && (e->width <= 0 || e->height <= 0 || e->size < (uint64_t)e->width * e->height * 4)) {
+			return false;
+		}
+	}
+
+	p->data = data;
+	p->size = size;
+	p->entries = entries;
+	p->count = h->count;
+	return true;
+}
+
+const PackEntry *pack_find(const Pack *p, const char *name) {
+	uint32_t lo = 0, hi = p->count;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		int32_t order = strcmp(name, p->entries[mid].name);
+		if (order == 0) {
+			return &p->entries[mid];
+		}
+		if (order < 0) {
+			hi = mid;
+		}
+		else {
+			lo = mid + 1;
+		}
+	}
+	return NULL;
+}
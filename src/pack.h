@@ -0,0 +1,67 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_PACK_H
+#define NEKO_PACK_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PACK_MAGIC   0x4B41504E // "NPAK"
+#define PACK_VERSION 1
+// Blobs start at multiples of this, so they can go to GL or be read by
+// stb_truetype right where they are mapped
+#define PACK_ALIGN   64
+#define PACK_NAME    56
+
+typedef enum
+{
+	// Bytes as they were on disk, like fonts
+	PACK_RAW,
+	// RGBA8 pixels of an image decoded at build time
+	PACK_PIXELS,
+	// A DDS or KTX2 file, already in a GPU format
+	PACK_TEXTURE,
+}
+PackKind;
+
+// A pack file is this header, `count` entries sorted by name and then the
+// blobs, all little endian. Names are the paths the packer was given.
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+}
+PackHeader;
+
+typedef struct
+{
+	char     name[PACK_NAME];
+	uint32_t kind;
+	int32_t  width;
+	int32_t  height;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+}
+PackEntry;
+
+// A pack read in place, no GL in here either
+typedef struct
+{
+	const uint8_t   *data;
+	size_t           size;
+	const PackEntry *entries;
+	uint32_t         count;
+}
+Pack;
+
+// Returns false when `data` isn't a pack or its entries point past the end
+bool pack_open(Pack *p, const void *data, size_t size);
+const PackEntry *pack_find(const Pack *p, const char *name);
+
+#endif
@@ -0,0 +1,166 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+// Builds a pack for renderer_mount_pack out of a directory, `make pack` runs:
+//   ./neko_pack data data.pack
+// Images are decoded here so the game only has to upload them, DDS and KTX2
+// files are kept as they are and everything else goes in untouched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+#include "texfile.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+typedef struct
+{
+	PackEntry entry;
+	uint8_t  *data;
+}
+Blob;
+
+static Blob    *blobs;
+static uint32_t blob_count;
+static uint32_t blob_size;
+
+static void fail(const char *what, const char *path) {
+	fprintf(stderr, "Error: %s %s\n", what, path);
+	exit(1);
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		fail("couldn't open", path);
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	uint8_t *data = malloc(length > 0 ? length : 1);
+	if (length < 0 || fread(data, 1, length, file) != (size_t)length) {
+		fail("couldn't read", path);
+	}
+	fclose(file);
+	*size = length;
+	return data;
+}
+
+static void add_file(const char *path) {
+	if (strlen(path) >= PACK_NAME) {
+		fail("name too long for a pack", path);
+	}
+	if (blob_count == blob_size) {
+		blob_size = blob_size ? blob_size * 2 : 64;
+		blobs = realloc(blobs, blob_size * sizeof(Blob));
+	}
+
+	Blob *b = &blobs[blob_count++];
+	memset(b, 0, sizeof(Blob));
+	strcpy(b->entry.name, path);
+
+	size_t size;
+	uint8_t *data = read_file(path, &size);
+	TexFile tex;
+	int32_t w, h, n;
+	if (texfile_parse(&tex, data, size)) {
+		b->entry.kind = PACK_TEXTURE;
+		b->entry.width = tex.width;
+		b->entry.height = tex.height;
+	}
+	else if (stbi_info_from_memory(data, size, &w, &h, &n)) {
+		uint8_t *pixels = stbi_load_from_memory(data, size, &w, &h, &n, 4);
+		if (!pixels) {
+			fail("couldn't decode", path);
+		}
+		free(data);
+		data = pixels;
+		size = (size_t)w * h * 4;
+		b->entry.kind = PACK_PIXELS;
+		b->entry.width = w;
+		b->entry.height = h;
+	}
+	else {
+		b->entry.kind = PACK_RAW;
+	}
+	b->entry.size = size;
+	b->data = data;
+}
+
+static void add_dir(const char *dir, const char *skip) {
+	DIR *d = opendir(dir);
+	if (!d) {
+		fail("couldn't open", dir);
+	}
+	struct dirent *it;
+	while ((it = readdir(d))) {
+		if (it->d_name[0] == '.') {
+			continue;
+		}
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/%s", dir, it->d_name);
+
+		struct stat st;
+		if (stat(path, &st) != 0) {
+			fail("couldn't stat", path);
+		}
+		if (S_ISDIR(st.st_mode)) {
+			add_dir(path, skip);
+		}
+		else if (strcmp(path, skip)) {
+			add_file(path);
+		}
+	}
+	closedir(d);
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(((const Blob *)a)->entry.name, ((const Blob *)b)->entry.name);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <directory> <pack>\n", argv[0]);
+		return 1;
+	}
+	add_dir(argv[1], argv[2]);
+	qsort(blobs, blob_count, sizeof(Blob), compare_names);
+
+	PackHeader header = { PACK_MAGIC, PACK_VERSION, blob_count, 0 };
+	uint64_t offset = sizeof(PackHeader) + blob_count * sizeof(PackEntry);
+	for (uint32_t i = 0; i < blob_count; i++) {
+		offset = (offset + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1);
+		blobs[i].entry.offset = offset;
+		offset += blobs[i].entry.size;
+	}
+
+	FILE *out = fopen(argv[2], "wb");
+	if (!out) {
+		fail("couldn't create", argv[2]);
+	}
+	fwrite(&header, sizeof(header), 1, out);
+	for (uint32_t i = 0; i < blob_count; i++) {
+		fwrite(&blobs[i].entry, sizeof(PackEntry), 1, out);
+	}
+	static const uint8_t zeros[PACK_ALIGN];
+	for (uint32_t i = 0; i < blob_count; i++) {
+		PackEntry *e = &blobs[i].entry;
+		fwrite(zeros, 1, e->offset - ftell(out), out);
+		fwrite(blobs[i].data, 1, e->size, out);
+
+		static const char *kinds[] = { "raw", "pixels", "texture" };
+		printf("%-40s %-8s %10llu bytes\n", e->name, kinds[e->kind], (unsigned long long)e->size);
+	}
+	if (ferror(out) || fclose(out) != 0) {
+		fail("couldn't write", argv[2]);
+	}
+	printf("%s: %u entries, %llu bytes\n", argv[2], blob_count, (unsigned long long)offset);
+	return 0;
+}
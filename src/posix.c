@@ -0,0 +1,209 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+// What the X11 and headless backends have in common, everything in
+// system.h that doesn't depend on the window.
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "system.h"
+#include "posix.h"
+
+// Display an error message and exit
+void system_panic(const char* message) {
+    fprintf(stderr, "Error: %s\n", message);
+    exit(1);
+}
+
+#ifdef GL_DEBUG
+void posix_debug_callback(
+    GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* user)
+{
+    (void)source;
+    (void)type;
+    (void)id;
+    (void)length;
+    (void)user;
+
+    fprintf(stderr, "OpenGL Debug: %s\n", message);
+    if (severity == GL_DEBUG_SEVERITY_HIGH || severity == GL_DEBUG_SEVERITY_MEDIUM) {
+        system_panic(message);
+    }
+}
+#endif
+
+void system_sleep(uint32_t milliseconds) {
+    usleep(milliseconds * 1000);
+}
+
+// Seconds from a monotonic clock, only differences are meaningful
+double system_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void *system_load_file(const char *filename, size_t *size_out) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    // Get file size
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    // Allocate memory and read file
+    void *data = malloc(size + 1); // +1 for null terminator if needed
+    if (!data) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read_size = fread(data, 1, size, file);
+    fclose(file);
+
+    if (read_size != (size_t)size) {
+        free(data);
+        return NULL;
+    }
+
+    // Add null terminator for text files
+    ((char*)data)[size] = '\0';
+    if (size_out) {
+        *size_out = size;
+    }
+    return data;
+}
+
+const void *system_map_file(const char *filename, size_t *size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file alive
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = st.st_size;
+    return data;
+}
+
+// $XDG_CACHE_HOME/neko/, or ~/.cache/neko/ without it
+const char *system_cache_dir() {
+    static char dir[4096];
+    if (dir[0]) {
+        return dir;
+    }
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n = 0;
+    if (xdg && xdg[0]) {
+        n = snprintf(dir, sizeof(dir), "%s/neko/", xdg);
+    }
+    else if (home && home[0]) {
+        snprintf(dir, sizeof(dir), "%s/.cache/", home);
+        mkdir(dir, 0755);
+        n = snprintf(dir, sizeof(dir), "%s/.cache/neko/", home);
+    }
+    if (n <= 0 || n >= (int)sizeof(dir) || (mkdir(dir, 0755) != 0 && errno != EEXIST)) {
+        dir[0] = '\0';
+    }
+    return dir;
+}
+
+bool system_replace_file(const char *from, const char *to) {
+    return rename(from, to) == 0;
+}
+
+uint32_t system_cpu_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+typedef struct {
+    void (*entry)(void *arg);
+    void *arg;
+} ThreadStart;
+
+static void *thread_main(void *start) {
+    ThreadStart s = *(ThreadStart *)start;
+    free(start);
+    s.entry(s.arg);
+    return NULL;
+}
+
+void system_create_thread(void (*entry)(void *arg), void *arg) {
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+    *start = (ThreadStart){ entry, arg };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, thread_main, start) != 0) {
+        system_panic("Couldn't create thread");
+    }
+    pthread_detach(thread);
+}
+
+void *system_create_mutex() {
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+void system_lock(void *mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+void system_unlock(void *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+void *system_create_semaphore() {
+    sem_t *semaphore = malloc(sizeof(sem_t));
+    sem_init(semaphore, 0, 0);
+    return semaphore;
+}
+
+void system_post(void *semaphore) {
+    sem_post(semaphore);
+}
+
+void system_wait(void *semaphore) {
+    // Signals may interrupt the wait
+    while (sem_wait(semaphore) != 0) { }
+}
+
+// Entry point defined by the user
+int32_t entry_point(void);
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    return entry_point();
+}
\ No newline at end of file
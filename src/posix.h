@@ -0,0 +1,20 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_POSIX_H
+#define NEKO_POSIX_H
+
+#include "opengl.h"
+
+// The X11 and headless backends only differ in their window, files, time,
+// threads, main and the GL debug output live in posix.c for both
+
+#ifdef GL_DEBUG
+// Prints what the driver reports and panics on the severe messages
+void posix_debug_callback(
+    GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* user);
+#endif
+
+#endif
@@ -3,80 +3,594 @@
 // license that can be found in the LICENSE file.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include <assert.h>
 
 #include "system.h"
 #include "renderer.h"
+#include "draw_common.h"
+#include "glyphs.h"
 #include "opengl.h"
 #include "common.h"
+#include "skyline.h"
+#include "texfile.h"
+#include "pack.h"
+#include "timing.h"
+#include "trace.h"
 
 #define STBI_NO_THREAD_LOCALS
 #define STB_IMAGE_IMPLEMENTATION
-#define STB_TRUETYPE_IMPLEMENTATION
-#include "stb/stb_truetype.h"
 #include "stb/stb_image.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define NEKO_SIMD_X86
+#include <immintrin.h>
+#endif
+
 #define ATTRIB_POSITION   0
 #define ATTRIB_COLOR      1
 #define ATTRIB_TEXCOORDS  2
+#define ATTRIB_AXES       3
+#define ATTRIB_SLOT       4
+
+#ifdef NEKO_INSTANCED
+// Build with -DNEKO_INSTANCED to send one record per quad, the vertex shader
+// expands the corners from gl_VertexID as pos + axis_a * cx + axis_b * cy.
+// Color and texture coordinates are always packed in this mode, the
+// coordinates are UNORM15 and the low bit of each one is a bit of the slot.
+typedef struct
+{
+	float    x, y;
+	float    ax, ay;
+	float    bx, by;
+	uint32_t color;
+	uint16_t u0, v0, u1, v1;
+}
+Quad;
+
+#define UV_SLOT_BITS 1
+#else
+// Build with -DNEKO_PACKED_VERTEX to use the 16 bytes vertex, colors are
+// RGBA8 and texture coordinates UNORM14 (clamped to 0..1, see TextureWrap),
+// the two low bits of u and v hold the texture slot.
+#ifdef NEKO_PACKED_VERTEX
+typedef struct
+{
+	float    x, y;
+	uint32_t color;
+	uint16_t u, v;
+}
+Vertex;
 
+#define UV_SLOT_BITS 2
+#else
 typedef struct
 {
-	float x, y;
-	float u, v;
-	float r, g, b, a;
+	float    x, y;
+	float    r, g, b, a;
+	float    u, v;
+	uint32_t slot;
 }
 Vertex;
+#endif
+
+typedef struct { Vertex v[4]; } Quad;
+#endif
+
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+typedef uint32_t QuadColor;
+#else
+typedef Color QuadColor;
+#endif
+
+// A quad before it gets written in the layout of the build: the first
+// corner and the edges from it to the second and the fourth ones.
+typedef struct
+{
+	float     x, y;
+	float     ax, ay;
+	float     bx, by;
+	float     u0, v0, u1, v1;
+	QuadColor color;
+}
+Shape;
 
+typedef struct
+{
+	Shape    shape;
+	uint32_t texture;
+	uint8_t  blend;
+}
+Command;
+
+#ifdef NEKO_INSTANCED
+INCBIN(general_vs_src, "src/shaders/instanced_vs.glsl");
+#elif defined(NEKO_PACKED_VERTEX)
+INCBIN(general_vs_src, "src/shaders/packed_vs.glsl");
+#else
 INCBIN(general_vs_src, "src/shaders/general_vs.glsl");
+#endif
 INCBIN(general_fs_src, "src/shaders/general_fs.glsl");
 
 static uint32_t compile_shader(const char *src, uint32_t kind);
 static uint32_t compile_shader_src(const char *vs, const char *fs);
-static inline Vertex make_v(float x, float y, float u, float v);
+static uint32_t load_program(const char *vs, const char *fs);
+static uint64_t program_key(const char *vs, const char *fs);
+static uint32_t cached_program(uint64_t key);
+static void cache_program(uint64_t key, uint32_t program);
+#ifndef NEKO_INSTANCED
+static inline Vertex make_v(float x, float y, float u, float v, QuadColor color);
+#endif
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+static inline uint16_t unorm_uv(float f, uint32_t slot_bits);
+static inline uint32_t slot_pair(uint32_t slot, uint32_t first);
+#endif
+static void bind_slots(const uint32_t *slots, uint32_t count);
+static void setup_attributes(uintptr_t offset);
+static void bind_texture(uint32_t unit, uint32_t id);
+static void forget_texture(uint32_t id);
+static void use_texture(uint32_t id);
+static void apply_blend(BlendMode b);
+static void blend_func(BlendMode b);
+static void emit(const Shape *s);
+static void submit(Shape *s);
+static inline bool shape_visible(const Shape *s);
+static inline void write_quad(Quad *q, const Shape *s);
+static inline Shape sprite_shape(const Sprite *sp);
+static uint32_t write_sprites(Quad *q, const Sprite *s, uint32_t n);
+#ifdef NEKO_SIMD_X86
+static uint32_t write_sprites_sse2(Quad *q, const Sprite *s, uint32_t n);
+static uint32_t write_sprites_avx2(Quad *q, const Sprite *s, uint32_t n);
+#endif
+static void flush(FlushReason reason);
+static void flush_batch(FlushReason reason);
+static void use_shader(uint32_t shader);
+static void play_commands();
+static Image atlas_add(int32_t width, int32_t height, const uint8_t *pixels);
+static Image atlas_region_image(uint32_t region);
+static void atlas_free(uint32_t region);
+static bool gl_supports(GLint major, GLint minor, const char *extension);
+static Image compressed_image(const TexFile *t);
+static Image pixels_image(int32_t width, int32_t height, const uint8_t *pixels);
+static Image load_image(const char *filename);
+static void texture_storage(GLenum format, int32_t width, int32_t height, int32_t levels);
+static void stream_init();
+static void stream_next_region();
+static void enable_attributes();
+static void create_batch_buffers(uint32_t *vao, uint32_t *vbo);
+static void record_batch(uint32_t count);
 
 #define MAX_QUADS (1 << 14)
 #define MAX_VERTS (MAX_QUADS * 4)
 #define MAX_INDXS (MAX_QUADS * 6)
 
+// Textures a single batch can sample from, every quad carries the index of
+// its slot and the fragment shader picks the sampler from it.
+#define MAX_TEXTURE_SLOTS 16
+
+#ifdef UV_SLOT_BITS
+// The largest texture coordinate the packed layouts store, the slot takes
+// the bits below it
+#define UV_MAX (0xFFFF >> UV_SLOT_BITS)
+#endif
+
+// Finished layouts are cached so strings drawn every frame skip decoding,
+// glyph lookups, kerning and line breaking. They are keyed by a copy of the
+// string and the style, the hash only picks the bucket. Their glyphs live
+// in blocks of a fixed pool, when the pool or the table runs out the least
+// recently drawn layout gives its blocks up.
+#define TEXT_LAYOUTS    512
+#define TEXT_BUCKETS    512
+#define TEXT_BLOCK      32
+#define TEXT_BLOCKS     512
+// Longer texts would push everything else out, they are laid out every time
+#define TEXT_MAX_CACHED (TEXT_BLOCK * TEXT_BLOCKS / 4)
+
+typedef struct
+{
+	uint64_t hash;
+	char    *text;
+	size_t   length;
+	uint32_t font;
+	float    size, width;
+	uint32_t last_used;
+	uint32_t glyph_count;
+	int16_t  first_block;
+	int16_t  next;
+}
+TextLayout;
+
+static void store_glyph(int32_t x, int32_t y, const uint8_t *texels, const Glyph *old);
+static uint64_t text_hash(uint32_t font, const char *text, size_t length, float size, float width);
+static bool layout_matches(const TextLayout *l, uint32_t font, const char *text, size_t length, float size, float width);
+static void layout_evict();
+static void draw_glyphs(uint32_t font, LaidGlyph *glyphs, uint32_t count, float x, float y);
+
+// Quads recorded while sorting, their keys pack from the top bit the layer
+// (8 bits), depth (16), blend mode (4), shader (4, there is only one for
+// now), texture (16) and the index of the command (16), which also keeps
+// quads with equal keys in submission order.
+#define MAX_COMMANDS (1 << 16)
+
+// Images loaded from disk up to ATLAS_MAX_IMAGE pixels share atlas pages,
+// each one surrounded by ATLAS_PADDING pixels copied from its own border
+// so linear filtering never picks up the neighbours.
+#define ATLAS_PAGE_SIZE    1024
+#define ATLAS_MAX_PAGES    8
+#define ATLAS_MAX_REGIONS  4096
+#define ATLAS_MAX_IMAGE    256
+#define ATLAS_PADDING      1
+
+typedef struct
+{
+	uint32_t id;
+	uint32_t live;
+	int64_t  area;
+	Skyline  packer;
+}
+AtlasPage;
+
+typedef struct
+{
+	bool     live;
+	uint16_t page;
+	int16_t  x, y;
+	int16_t  w, h;
+}
+AtlasRegion;
+
+// Quads recorded between renderer_begin_static and renderer_end_static go
+// into a buffer of their own. Every flush while recording closes a segment
+// that keeps the textures, blend mode and projection it needs to be drawn
+// with. Frames recorded for damage tracking also have segments that draw a
+// static batch or switch between the window and a render target.
+#define MAX_STATIC_BATCHES 64
+
+typedef enum
+{
+	SEGMENT_QUADS,
+	// Draws static batch `first`
+	SEGMENT_STATIC,
+	// Goes on drawing into target `first` - 1, or to the window when 0
+	SEGMENT_TARGET,
+}
+SegmentKind;
+
+typedef struct
+{
+	SegmentKind kind;
+	uint32_t    first;
+	uint32_t    count;
+	uint32_t    slots[MAX_TEXTURE_SLOTS];
+	uint32_t    slot_count;
+	BlendMode   blend;
+	mat4        proj_view;
+}
+Segment;
+
+typedef struct
+{
+	uint32_t  vao;
+	uint32_t  vbo;
+	Segment  *segments;
+	uint32_t  segment_count;
+}
+StaticData;
+
+// Textures with a framebuffer to draw into them, cached ones are only
+// drawn again after being invalidated.
+#define MAX_TARGETS 32
+
+typedef struct
+{
+	uint32_t texture;
+	uint32_t fbo;
+	int32_t  width, height;
+	bool     cached;
+	bool     dirty;
+}
+RenderTarget;
+
+static void create_framebuffer(RenderTarget *target, int32_t width, int32_t height);
+static void bind_target(uint32_t target);
+static void restore_framebuffer();
+static void draw_segments(uint32_t vao, uint32_t vbo, const Segment *segments, uint32_t count, const mat4 *proj_view);
+static Segment *push_segment(SegmentKind kind, uint32_t first, uint32_t count);
+static bool end_frame();
+static void present_frame(const int32_t *rect);
+static void flush_now(FlushReason reason);
+static bool damaged_rect(int32_t *rect);
+static void quad_bounds(const Quad *q, float *b);
+
+// Images from renderer_load_image_async are decoded by worker threads and
+// handed back through `load_done`. Then the renderer uploads them a few
+// rows at a time through a pixel buffer, spending at most `upload_budget`
+// bytes a frame, and their handles stand for the placeholder until done.
+// Files that can't be read or decoded keep the placeholder for good.
+#define MAX_LOADS     1024
+#define LOAD_THREADS  2
+#define UPLOAD_BUDGET (4 << 20)
+
+typedef enum
+{
+	LOAD_FREE,
+	// Waiting for or being decoded by a worker
+	LOAD_QUEUED,
+	// Decoded and waiting in `uploads`
+	LOAD_DECODED,
+	LOAD_READY,
+	LOAD_FAILED,
+}
+LoadState;
+
+typedef struct
+{
+	LoadState state;
+	// Freed before getting ready, dropped when the renderer gets to it
+	bool      cancelled;
+	// Pixels come straight from the mounted pack instead of a worker
+	bool      mapped;
+	uint32_t  group;
+	char     *filename;
+	uint8_t  *pixels;
+	// Texture being uploaded and how many rows of it already are
+	uint32_t  texture;
+	int32_t   rows;
+	Image     image;
+}
+ImageLoad;
+
+static void load_worker(void *arg);
+static void upload_loads(uint32_t budget);
+static bool upload_rows(ImageLoad *load, uint32_t *budget);
+static void finish_load(ImageLoad *load, Image image);
+
+// Frame timing reads timestamp queries back TIMER_FRAMES frames later, when
+// the GPU is long done with them, so it never waits on the GPU. Each frame
+// has a pair of queries for itself and one per flush, up to TIMER_FLUSHES.
+#define TIMER_FRAMES  4
+#define TIMER_FLUSHES 32
+
+typedef struct
+{
+	uint32_t queries[2 + TIMER_FLUSHES * 2];
+	uint32_t flush_count;
+	bool     pending;
+}
+TimerFrame;
+
+static void timer_begin_frame();
+static void timer_end_frame();
+static void timer_collect(TimerFrame *t);
+static uint32_t *timer_flush_queries();
+static void timer_flush_done(uint32_t *queries, double start);
+static void log_stats();
+
+// Linked programs are kept between runs in this file of system_cache_dir,
+// keyed by a hash of their sources and of the driver. Defining SHADER_CACHE
+// as a path puts the cache there instead, an empty one turns it off.
+#define SHADER_CACHE_NAME "shaders.cache"
+
+// Record of the shader cache, followed by `size` bytes of program binary
+typedef struct
+{
+	uint64_t key;
+	uint32_t format;
+	uint32_t size;
+}
+CachedProgram;
+
+// The vertex buffer is a ring of regions with room for MAX_QUADS each, so
+// the CPU can fill one while the GPU still reads the previous ones.
+#define STREAM_REGIONS 3
+
 static struct
 {
 	uint32_t  vao;
 	uint32_t  vbo;
 	uint32_t  ebo;
 	uint32_t  shader;
+	// What glUseProgram was last called with
+	uint32_t  program;
+
+	// NOTE: `quads` points into the persistently mapped buffer when the
+	// driver has ARB_buffer_storage, otherwise into `staging`, which gets
+	// copied through an unsynchronized map on every flush.
+	Quad     *quads;
+	Quad     *mapped;
+	GLsync    fences[STREAM_REGIONS];
+	uint32_t  region;
+	uint32_t  first_quad;
 
 	int32_t   proj_view_loc;
 	mat4      proj_view;
+	// Slot of the glyph atlas in the batch being drawn, -1 without one
+	int32_t   sdf_slot_loc;
+	int32_t   sdf_slot;
 
 	Image     pixel;
+	Image     placeholder;
 	Image     hot_image;
-	Color     hot_color;
+	float     hot_uv[4];
+	QuadColor hot_color;
+	uint32_t  hot_slot;
+	uint8_t   hot_layer;
+	uint16_t  hot_depth;
+	BlendMode hot_blend;
+	BlendMode blend;
 
-	Vertex    vertices[MAX_VERTS];
-	uint32_t  curr_vert;
+	TransformStack transform;
+
+	SimdLevel     simd;
+
+	// Quads whose bounds miss the view rect are dropped before the batch
+	bool          culling;
+	float         view[4];
+
+	// Textures used by the pending batch and what each unit has bound
+	uint32_t  slots[MAX_TEXTURE_SLOTS];
+	uint32_t  slot_count;
+	uint32_t  max_slots;
+	uint32_t  bound[MAX_TEXTURE_SLOTS];
+
+	Quad      staging[MAX_QUADS];
 	uint32_t  curr_quad;
+
+	bool      sorting;
+	Command   commands[MAX_COMMANDS];
+	uint64_t  keys[MAX_COMMANDS];
+	uint64_t  sort_tmp[MAX_COMMANDS];
+	uint32_t  command_count;
+
+	GlyphCache  glyphs;
+	uint32_t    glyph_texture;
+
+	TextLayout  layouts[TEXT_LAYOUTS];
+	int16_t     layout_buckets[TEXT_BUCKETS];
+	int16_t     free_layout;
+	uint32_t    layout_tick;
+	LaidGlyph   blocks[TEXT_BLOCKS][TEXT_BLOCK];
+	int16_t     block_next[TEXT_BLOCKS];
+	int16_t     free_block;
+	uint32_t    free_blocks;
+
+	AtlasPage   pages[ATLAS_MAX_PAGES];
+	AtlasRegion regions[ATLAS_MAX_REGIONS];
+	uint32_t    fbos[2];
+
+	RenderTarget  targets[MAX_TARGETS];
+	// Index + 1 of the target being drawn into, and what the window had
+	uint32_t      target;
+	mat4          window_proj_view;
+	float         window_view[4];
+	mat3x2        window_transform;
+	TransformKind window_transform_kind;
+
+	StaticData    statics[MAX_STATIC_BATCHES];
+	// While recording quads go through `staging` and each flush moves them
+	// here, a static batch recorded in the middle of a deferred frame starts
+	// at `static_quads` and `static_segments`.
+	bool          recording;
+	bool          recording_culling;
+	bool          recording_sorting;
+	uint32_t      recording_from;
+	uint32_t      static_quads;
+	uint32_t      static_segments;
+	Quad         *recorded;
+	uint32_t      recorded_count;
+	uint32_t      recorded_size;
+	Segment      *segments;
+	uint32_t      segment_count;
+	uint32_t      segment_size;
+
+	// With damage tracking frames are recorded like static batches and only
+	// drawn by renderer_end_frame, after comparing them with the last one.
+	// `frame_dirty` is set when textures change under the quads, and
+	// `frame_started` when part of the frame had to be drawn early.
+	DamageMode    damage;
+	bool          deferring;
+	bool          frame_dirty;
+	bool          frame_started;
+	uint32_t      frame_vao;
+	uint32_t      frame_vbo;
+	// What the window shows lives in `frame` for partial redraws, since the
+	// back buffer doesn't keep the last frame
+	RenderTarget  frame;
+	uint32_t      window_fbo;
+	Quad         *last_quads;
+	uint32_t      last_quad_count;
+	uint32_t      last_quad_size;
+	Segment      *last_segments;
+	uint32_t      last_segment_count;
+	uint32_t      last_segment_size;
+
+	// Workers only touch the job and done queues, under `load_mutex`, and
+	// the pixels of the load they took. The rest is the renderer's.
+	ImageLoad     loads[MAX_LOADS];
+	uint32_t      loads_pending;
+	uint32_t      load_jobs[MAX_LOADS];
+	uint32_t      jobs_head, jobs_tail;
+	uint32_t      load_done[MAX_LOADS];
+	uint32_t      done_head, done_tail;
+	uint32_t      uploads[MAX_LOADS];
+	uint32_t      uploads_head, uploads_tail;
+	void         *load_mutex;
+	void         *load_signal;
+	uint32_t      upload_pbo;
+	uint32_t      upload_pbo_size;
+	uint32_t      upload_budget;
+
+	// Block compressed formats the driver takes as they are, the others
+	// are expanded to RGBA8 on load
+	bool          compressed[TEXFILE_FORMATS];
+	// glTexStorage2D is there, textures are allocated immutable
+	bool          tex_storage;
+	// Program binaries can be read back and loaded in these formats
+	GLint        *binary_formats;
+	GLint         binary_format_count;
+	char          shader_cache[1024];
+	StartupStats  startup;
+
+	// Mapped by renderer_mount_pack, stays mapped for good
+	Pack          pack;
+
+	RendererStats stats;
+	// renderer_log_stats prints every `log_frames` frames
+	uint32_t      log_frames;
+	uint32_t      frame_count;
+
+	TimerFrame    timer_frames[TIMER_FRAMES];
+	uint32_t      timer_frame;
+	// CPU clock when the current frame started, 0 outside of frames
+	double        frame_start;
+	TimingSeries  frame_cpu;
+	TimingSeries  frame_gpu;
+	TimingSeries  flush_cpu;
+	TimingSeries  flush_gpu;
+	TimingSeries  swap_cpu;
 }
 self = { 0 };
 
 void renderer_init() {
+	double start = system_time();
+	GLint units = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+	self.max_slots = units < MAX_TEXTURE_SLOTS ? units : MAX_TEXTURE_SLOTS;
+	self.tex_storage = gl_supports(4, 2, "GL_ARB_texture_storage") && glTexStorage2D;
+
 	// Create the pixel image
 	self.pixel = renderer_mem_image(1, 1, (uint8_t[]){255, 255, 255, 255});
 	renderer_set_image(self.pixel);
+	// Images still loading are drawn transparent
+	self.placeholder = renderer_mem_image(1, 1, (uint8_t[]){0, 0, 0, 0});
+	self.upload_budget = UPLOAD_BUDGET;
 
 	// Default color as white
-	self.hot_color = WHITE;
+	renderer_set_color(WHITE);
+	transform_reset(&self.transform);
+	renderer_set_simd(SIMD_AVX2);
+	self.culling = true;
+
+	self.compressed[TEXFILE_BC1] = gl_supports(0, 0, "GL_EXT_texture_compression_s3tc");
+	self.compressed[TEXFILE_BC3] = self.compressed[TEXFILE_BC1];
+	self.compressed[TEXFILE_BC7] = gl_supports(4, 2, "GL_ARB_texture_compression_bptc");
+	self.compressed[TEXFILE_ETC2_RGB] = gl_supports(4, 3, "GL_ARB_ES3_compatibility");
+	self.compressed[TEXFILE_ETC2_RGBA] = self.compressed[TEXFILE_ETC2_RGB];
 
 	// Create the vertex array object
 	glGenVertexArrays(1, &self.vao);
 	glBindVertexArray(self.vao);
 
 	// Create the vertex buffer object
-	glGenBuffers(1, &self.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, self.vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(self.vertices), NULL, GL_DYNAMIC_DRAW);
+	stream_init();
 
+	// Setup attributes
+	enable_attributes();
+
+#ifndef NEKO_INSTANCED
 	// NOTE(ellora):
 	// Indices are allways the same, so we can just set them once.
 	uint32_t indxs[MAX_INDXS];
@@ -91,165 +605,2639 @@ void renderer_init() {
 	glGenBuffers(1, &self.ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self.ebo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indxs), indxs, GL_STATIC_DRAW);
+#endif
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
-	// Compiling shaders
-	self.shader = compile_shader_src(
+	// Compiling shaders, or loading them as the driver left them last time
+	if (gl_supports(4, 1, "GL_ARB_get_program_binary") && glGetProgramBinary && glProgramBinary && glProgramParameteri) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &self.binary_format_count);
+		self.binary_formats = malloc((self.binary_format_count + 1) * sizeof(GLint));
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, self.binary_formats);
+#ifdef SHADER_CACHE
+		snprintf(self.shader_cache, sizeof(self.shader_cache), "%s", SHADER_CACHE);
+#else
+		const char *dir = system_cache_dir();
+		if (dir[0]) {
+			snprintf(self.shader_cache, sizeof(self.shader_cache), "%s" SHADER_CACHE_NAME, dir);
+		}
+#endif
+	}
+	double shaders_start = system_time();
+	self.shader = load_program(
 		incbin_general_vs_src_start,
 		incbin_general_fs_src_start);
 	assert(self.shader != 0);
-	glUseProgram(self.shader);
+	self.startup.shaders_ms = (float)((system_time() - shaders_start) * 1000.0);
+	use_shader(self.shader);
 	self.proj_view_loc = glGetUniformLocation(self.shader, "u_proj_view");
 	assert(self.proj_view_loc != -1);
+
+	// Sampler i always reads from texture unit i
+	GLint units_loc = glGetUniformLocation(self.shader, "u_textures");
+	GLint samplers[MAX_TEXTURE_SLOTS];
+	for (int32_t i = 0; i < MAX_TEXTURE_SLOTS; i++) {
+		samplers[i] = i;
+	}
+	glUniform1iv(units_loc, MAX_TEXTURE_SLOTS, samplers);
+	self.sdf_slot_loc = glGetUniformLocation(self.shader, "u_sdf_slot");
+	self.sdf_slot = -1;
+	glUniform1i(self.sdf_slot_loc, self.sdf_slot);
+	self.startup.init_ms = (float)((system_time() - start) * 1000.0);
 }
 
 void renderer_frame() {
+	TRACE_BEGIN("renderer_frame");
+	if (system_window_damaged()) {
+		renderer_invalidate_frame();
+	}
+	timer_begin_frame();
 	// TODO(ellora): to fix, this is the frame size not the window...
 	vec2 w_size = system_window_size();
 	mat4 view = math_mat4_identity();
 	mat4 proj = math_mat4_ortho(0.f, w_size.x, w_size.y, 0.f, -1.f, 1.f);
 	self.proj_view = math_mat4_mul(proj, view);
+	self.view[0] = 0.f;
+	self.view[1] = 0.f;
+	self.view[2] = w_size.x;
+	self.view[3] = w_size.y;
 
-	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glViewport(0, 0, w_size.x, w_size.y);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	transform_reset(&self.transform);
+
+	// Counters are per frame, except the ones about skipped frames
+	if (self.log_frames && self.frame_count && self.frame_count % self.log_frames == 0) {
+		log_stats();
+	}
+	self.frame_count++;
+	self.stats = (RendererStats){
+		.frames_skipped = self.stats.frames_skipped,
+		.frames_partial = self.stats.frames_partial };
+	upload_loads(self.upload_budget);
+	// Start the frame on a fresh region of the vertex ring
+	if (self.curr_quad == self.first_quad) {
+		stream_next_region();
+	}
 	glEnable(GL_BLEND);
+	blend_func(self.blend);
+
+	if (self.damage == DAMAGE_OFF) {
+		self.window_fbo = 0;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glViewport(0, 0, w_size.x, w_size.y);
+		TRACE_END();
+		return;
+	}
+
+	if (self.damage == DAMAGE_PARTIAL && (self.frame.width != (int32_t)w_size.x || self.frame.height != (int32_t)w_size.y)) {
+		if (self.frame.fbo) {
+			glDeleteFramebuffers(1, &self.frame.fbo);
+			glDeleteTextures(1, &self.frame.texture);
+			self.window_fbo = 0;
+		}
+		create_framebuffer(&self.frame, (int32_t)w_size.x, (int32_t)w_size.y);
+		self.frame_dirty = true;
+	}
+	self.window_fbo = self.damage == DAMAGE_PARTIAL ? self.frame.fbo : 0;
+
+	// Nothing gets drawn until renderer_end_frame
+	self.deferring = true;
+	self.frame_started = false;
+	self.recording_from = self.curr_quad;
+	self.quads = self.staging;
+	self.curr_quad = 0;
+	self.first_quad = 0;
+	self.recorded_count = 0;
+	self.segment_count = 0;
+	TRACE_END();
+}
+
+bool renderer_end_frame() {
+	TRACE_BEGIN("renderer_end_frame");
+	bool drawn = end_frame();
+	timer_end_frame();
+	TRACE_END();
+	return drawn;
+}
+
+bool end_frame() {
+	flush(FLUSH_FRAME);
+	if (!self.deferring) {
+		return true;
+	}
+	self.deferring = false;
+	self.quads = self.mapped ? self.mapped + self.region * MAX_QUADS : self.staging;
+	self.curr_quad = self.recording_from;
+	self.first_quad = self.recording_from;
+
+	// Same segments and as many quads as last time, then only the quads
+	// that changed need to be drawn again
+	bool same = !self.frame_dirty && !self.frame_started
+		&& self.segment_count == self.last_segment_count
+		&& self.recorded_count == self.last_quad_count
+		&& !memcmp(self.segments, self.last_segments, self.segment_count * sizeof(Segment));
+	int32_t rect[4] = { 0, 0, (int32_t)self.view[2], (int32_t)self.view[3] };
+	bool partial = false;
+	if (same) {
+		if (!memcmp(self.recorded, self.last_quads, self.recorded_count * sizeof(Quad))) {
+			self.stats.frames_skipped++;
+			return false;
+		}
+		if (self.damage == DAMAGE_PARTIAL) {
+			partial = damaged_rect(rect);
+		}
+	}
+
+	present_frame(partial ? rect : NULL);
+	if (self.window_fbo) {
+		int32_t w = self.frame.width;
+		int32_t h = self.frame.height;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, self.window_fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	self.stats.frames_partial += partial;
+	self.frame_dirty = false;
+
+	// This frame is what the next one gets compared against
+	Quad *quads = self.last_quads;
+	self.last_quads = self.recorded;
+	self.recorded = quads;
+	uint32_t size = self.last_quad_size;
+	self.last_quad_size = self.recorded_size;
+	self.recorded_size = size;
+	self.last_quad_count = self.recorded_count;
+
+	Segment *segments = self.last_segments;
+	self.last_segments = self.segments;
+	self.segments = segments;
+	size = self.last_segment_size;
+	self.last_segment_size = self.segment_size;
+	self.segment_size = size;
+	self.last_segment_count = self.segment_count;
+	return true;
+}
+
+void renderer_set_damage(DamageMode mode) {
+	flush(FLUSH_STATE);
+	self.damage = mode;
+	self.frame_dirty = true;
+	if (mode != DAMAGE_PARTIAL && self.frame.fbo) {
+		glDeleteFramebuffers(1, &self.frame.fbo);
+		glDeleteTextures(1, &self.frame.texture);
+		self.frame = (RenderTarget){ 0 };
+	}
+}
+
+void renderer_invalidate_frame() {
+	self.frame_dirty = true;
+}
+
+// Draws the frame recorded so far to the window, only inside `rect` when
+// it isn't NULL.
+void present_frame(const int32_t *rect) {
+	uint32_t *queries = timer_flush_queries();
+	double start = system_time();
+	bind_target(0);
+	if (!self.frame_started) {
+		if (rect) {
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(rect[0], (int32_t)self.view[3] - rect[3], rect[2] - rect[0], rect[3] - rect[1]);
+		}
+		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	if (!self.frame_vao) {
+		create_batch_buffers(&self.frame_vao, &self.frame_vbo);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, self.frame_vbo);
+	glBufferData(GL_ARRAY_BUFFER, self.recorded_count * sizeof(Quad), self.recorded, GL_STREAM_DRAW);
+	self.stats.vertex_bytes += self.recorded_count * sizeof(Quad);
+	draw_segments(self.frame_vao, self.frame_vbo, self.segments, self.segment_count, NULL);
+	glDisable(GL_SCISSOR_TEST);
+	self.glyphs.flushed = self.glyphs.tick;
+	timer_flush_done(queries, start);
+}
+
+// Draws a deferred frame up to here when something is about to change the
+// textures its quads sample from.
+void flush_now(FlushReason reason) {
+	flush(reason);
+	if (self.deferring && self.segment_count) {
+		present_frame(NULL);
+		self.frame_started = true;
+		self.frame_dirty = true;
+		self.recorded_count = 0;
+		self.segment_count = 0;
+	}
+}
+
+// Bounds in window pixels of the quads that aren't the same as last frame,
+// both where they were and where they are. False when that is everything.
+bool damaged_rect(int32_t *rect) {
+	float damage[4] = { self.view[2], self.view[3], 0.f, 0.f };
+	for (uint32_t i = 0; i < self.recorded_count; i++) {
+		if (!memcmp(&self.recorded[i], &self.last_quads[i], sizeof(Quad))) {
+			continue;
+		}
+		float b[4];
+		quad_bounds(&self.recorded[i], b);
+		damage_add(damage, b);
+		quad_bounds(&self.last_quads[i], b);
+		damage_add(damage, b);
+	}
+	return damage_clip(damage, rect);
+}
+
+void quad_bounds(const Quad *q, float *b) {
+#ifdef NEKO_INSTANCED
+	float xs[4] = { q->x, q->x + q->ax, q->x + q->ax + q->bx, q->x + q->bx };
+	float ys[4] = { q->y, q->y + q->ay, q->y + q->ay + q->by, q->y + q->by };
+#else
+	float xs[4] = { q->v[0].x, q->v[1].x, q->v[2].x, q->v[3].x };
+	float ys[4] = { q->v[0].y, q->v[1].y, q->v[2].y, q->v[3].y };
+#endif
+	b[0] = b[2] = xs[0];
+	b[1] = b[3] = ys[0];
+	for (int32_t i = 1; i < 4; i++) {
+		b[0] = xs[i] < b[0] ? xs[i] : b[0];
+		b[1] = ys[i] < b[1] ? ys[i] : b[1];
+		b[2] = xs[i] > b[2] ? xs[i] : b[2];
+		b[3] = ys[i] > b[3] ? ys[i] : b[3];
+	}
 }
 
 void renderer_flush() {
-	if (self.curr_quad == 0) {
+	flush(FLUSH_EXPLICIT);
+}
+
+void flush(FlushReason reason) {
+	TRACE_BEGIN("renderer_flush");
+	if (self.command_count) {
+		play_commands();
+	}
+	flush_batch(reason);
+	TRACE_END();
+}
+
+void flush_batch(FlushReason reason) {
+	if (!self.command_count && !self.deferring) {
+		self.glyphs.flushed = self.glyphs.tick;
+	}
+	uint32_t count = self.curr_quad - self.first_quad;
+	if (count == 0) {
+		return;
+	}
+	self.stats.flushes[reason]++;
+	if (self.recording || self.deferring) {
+		record_batch(count);
+		self.first_quad = self.curr_quad;
 		return;
 	}
 
+	uint32_t *queries = timer_flush_queries();
+	double start = system_time();
+
 	// Bind the vertex array object
 	glBindVertexArray(self.vao);
-
-	// Update the vertex buffer
 	glBindBuffer(GL_ARRAY_BUFFER, self.vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, self.curr_vert * sizeof(Vertex), self.vertices);
 
-	// Setup attributes
-	glEnableVertexAttribArray(ATTRIB_POSITION);
-	glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(ATTRIB_COLOR);
-	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(2 * sizeof(float)));
-	glEnableVertexAttribArray(ATTRIB_TEXCOORDS);
-	glVertexAttribPointer(ATTRIB_TEXCOORDS, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+	// Update the vertex buffer, the region is fenced so nobody reads
+	// this range and the driver doesn't need to synchronize the map.
+	uint32_t base = self.region * MAX_QUADS + self.first_quad;
+	if (!self.mapped) {
+		void *dst = glMapBufferRange(GL_ARRAY_BUFFER, base * sizeof(Quad), count * sizeof(Quad),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		memcpy(dst, self.quads + self.first_quad, count * sizeof(Quad));
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	self.stats.vertex_bytes += count * sizeof(Quad);
 
 	// Draw the quads
-	glUseProgram(self.shader);
+	use_shader(self.shader);
 	// NOTE(ellora): For some reason we need to transpose the matrix...
 	glUniformMatrix4fv(self.proj_view_loc, 1, GL_TRUE, &self.proj_view.m0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self.ebo);
-	glBindTexture(GL_TEXTURE_2D, self.hot_image.id);
-	glDrawElements(GL_TRIANGLES, self.curr_quad * 6, GL_UNSIGNED_INT, 0);
+	bind_slots(self.slots, self.slot_count);
+#ifdef NEKO_INSTANCED
+	setup_attributes(base * sizeof(Quad));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+#else
+	glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_INT, 0, base * 4);
+#endif
+	self.stats.draw_calls++;
+	self.stats.vertices += count * 4;
+	timer_flush_done(queries, start);
 
 	// Reset stuff
-	self.curr_quad = 0;
-	self.curr_vert = 0;
+	self.first_quad = self.curr_quad;
 }
 
-void renderer_set_color(Color c) {
-	self.hot_color = c;
+RendererStats renderer_get_stats() {
+	RendererStats stats = self.stats;
+
+	int64_t area = 0;
+	for (uint32_t p = 0; p < ATLAS_MAX_PAGES; p++) {
+		if (self.pages[p].id) {
+			stats.atlas_pages++;
+			area += self.pages[p].area;
+		}
+	}
+	if (stats.atlas_pages) {
+		stats.atlas_fill = (float)area / ((float)stats.atlas_pages * ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE);
+	}
+	return stats;
 }
 
-void renderer_set_image(Image i) {
-	if (i.id != self.hot_image.id) {
-		renderer_flush();
+StartupStats renderer_get_startup_stats() {
+	return self.startup;
+}
+
+FrameStats renderer_get_frame_stats() {
+	return (FrameStats){
+		.frame_cpu = timing_summary(&self.frame_cpu),
+		.frame_gpu = timing_summary(&self.frame_gpu),
+		.flush_cpu = timing_summary(&self.flush_cpu),
+		.flush_gpu = timing_summary(&self.flush_gpu),
+		.swap_cpu  = timing_summary(&self.swap_cpu) };
+}
+
+void renderer_log_stats(uint32_t frames) {
+	self.log_frames = frames;
+}
+
+void log_stats() {
+	RendererStats s = renderer_get_stats();
+	Timing cpu = timing_summary(&self.frame_cpu);
+	fprintf(stderr,
+		"frame %u: %u draws, %u vertices, %u quads, %u culled, "
+		"flushes %u explicit %u frame %u texture %u overflow %u state, "
+		"%u vertex bytes, %u texture bytes, %u texture binds, %u shader binds, "
+		"cpu %.2f ms p95 %.2f ms\n",
+		self.frame_count, s.draw_calls, s.vertices, s.quads_drawn, s.quads_culled,
+		s.flushes[FLUSH_EXPLICIT], s.flushes[FLUSH_FRAME], s.flushes[FLUSH_TEXTURE],
+		s.flushes[FLUSH_OVERFLOW], s.flushes[FLUSH_STATE],
+		s.vertex_bytes, s.texture_bytes, s.texture_binds, s.shader_binds,
+		cpu.last, cpu.p95);
+}
+
+void renderer_swap_buffers() {
+	double start = system_time();
+	system_swap_buffers();
+	timing_push(&self.swap_cpu, (float)((system_time() - start) * 1000.0));
+}
+
+void timer_begin_frame() {
+	if (self.frame_start) {
+		timer_end_frame();
 	}
+	TimerFrame *t = &self.timer_frames[self.timer_frame];
+	if (!t->queries[0]) {
+		glGenQueries(2 + TIMER_FLUSHES * 2, t->queries);
+	}
+	if (t->pending) {
+		timer_collect(t);
+	}
+	t->flush_count = 0;
+	glQueryCounter(t->queries[0], GL_TIMESTAMP);
+	self.frame_start = system_time();
+}
 
-	self.hot_image = i;
+void timer_end_frame() {
+	if (!self.frame_start) {
+		return;
+	}
+	TimerFrame *t = &self.timer_frames[self.timer_frame];
+	glQueryCounter(t->queries[1], GL_TIMESTAMP);
+	t->pending = true;
+	self.timer_frame = (self.timer_frame + 1) % TIMER_FRAMES;
+	timing_push(&self.frame_cpu, (float)((system_time() - self.frame_start) * 1000.0));
+	self.frame_start = 0;
 }
 
-Image renderer_load_image(const char *filename) {
-	int32_t w, h, n;
-	uint8_t *pixels = stbi_load(filename, &w, &h, &n, 4); // Force RGBA
-	if (pixels == NULL) {
-		system_panic("Could't load image");
+// Results are dropped rather than waited for when the GPU is still behind
+void timer_collect(TimerFrame *t) {
+	t->pending = false;
+	GLint available = 0;
+	glGetQueryObjectiv(t->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return;
 	}
-	Image img = renderer_mem_image(w, h, pixels);
-	stbi_image_free(pixels);
+	uint64_t begin, end;
+	glGetQueryObjectui64v(t->queries[0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(t->queries[1], GL_QUERY_RESULT, &end);
+	timing_push(&self.frame_gpu, (float)(end - begin) * 1e-6f);
+	for (uint32_t i = 0; i < t->flush_count; i++) {
+		glGetQueryObjectui64v(t->queries[2 + i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(t->queries[3 + i * 2], GL_QUERY_RESULT, &end);
+		timing_push(&self.flush_gpu, (float)(end - begin) * 1e-6f);
+	}
+}
 
-	return img;
+// Timestamps around a flush, NULL outside of frames or when the frame is
+// out of queries
+uint32_t *timer_flush_queries() {
+	TimerFrame *t = &self.timer_frames[self.timer_frame];
+	if (!self.frame_start || t->flush_count == TIMER_FLUSHES) {
+		return NULL;
+	}
+	uint32_t *queries = &t->queries[2 + t->flush_count++ * 2];
+	glQueryCounter(queries[0], GL_TIMESTAMP);
+	return queries;
 }
 
-Image renderer_mem_image(int32_t width, int32_t height, const uint8_t *pixels) {
-	Image img = { .id = 0, .width = width, .height = height };
+void timer_flush_done(uint32_t *queries, double start) {
+	if (queries) {
+		glQueryCounter(queries[1], GL_TIMESTAMP);
+	}
+	timing_push(&self.flush_cpu, (float)((system_time() - start) * 1000.0));
+}
 
-	glGenTextures(1, &img.id);
-	glBindTexture(GL_TEXTURE_2D, img.id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+void renderer_set_color(Color c) {
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+	self.hot_color = pack_color(c);
+#else
+	self.hot_color = c;
+#endif
+}
 
-	return img;
+void renderer_set_blend(BlendMode b) {
+	self.hot_blend = b;
+	if (!self.sorting) {
+		apply_blend(b);
+	}
 }
 
-void renderer_push_quad(float x1, float y1, float x2, float y2, float u0, float u1, float v0, float v1) {
-	if (self.curr_quad >= MAX_QUADS) {
-		renderer_flush();
+void renderer_set_sorting(bool enabled) {
+	flush(FLUSH_STATE);
+	self.sorting = enabled;
+
+	// Playing the commands leaves whatever they used last as current
+	if (!enabled) {
+		apply_blend(self.hot_blend);
+		use_texture(self.hot_image.id);
 	}
+}
 
-	self.vertices[self.curr_vert++] = make_v(x1, y1, u0, v0);
-	self.vertices[self.curr_vert++] = make_v(x2, y1, u1, v0);
-	self.vertices[self.curr_vert++] = make_v(x2, y2, u1, v1);
-	self.vertices[self.curr_vert++] = make_v(x1, y2, u0, v1);
+void renderer_push_mat4() {
+	transform_push(&self.transform);
+}
 
-	self.curr_quad++;
+void renderer_pop_mat4() {
+	transform_pop(&self.transform);
 }
 
-// sugar dummy bunny way to create a vertex (because is pretty anoying write it manually)
-Vertex make_v(float x, float y, float u, float v) {
-	return (Vertex) {
-		x, y, self.hot_color.r, self.hot_color.g,
-		self.hot_color.b, self.hot_color.a, u, v };
+void renderer_translate(float x, float y) {
+	transform_translate(&self.transform, x, y);
 }
 
-uint32_t compile_shader(const char *src, uint32_t kind) {
-	uint32_t shader = glCreateShader(kind);
-	glShaderSource(shader, 1, &src, NULL);
-	glCompileShader(shader);
+void renderer_scale(float sx, float sy) {
+	transform_mul(&self.transform, math_mat3x2_scale(sx, sy));
+}
 
-	// Getting the result of compiling process
-	int32_t success;
-	char infoLog[512];
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(shader, 512, NULL, infoLog);
-		glDeleteShader(shader);
-		printf("[ERROR] %s\n", infoLog);
-		return 0;
-	}
+void renderer_rotate(float r) {
+	transform_mul(&self.transform, math_mat3x2_rotate(r));
+}
 
-	return shader;
+void renderer_set_culling(bool enabled) {
+	self.culling = enabled;
 }
 
-uint32_t compile_shader_src(const char *vs, const char *fs) {
-	uint32_t vertexShader = compile_shader(vs, GL_VERTEX_SHADER);
-	uint32_t fragmentShader = compile_shader(fs, GL_FRAGMENT_SHADER);
+void renderer_set_layer(uint8_t layer) {
+	self.hot_layer = layer;
+}
 
-	uint32_t program = glCreateProgram();
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-	glLinkProgram(program);
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+void renderer_set_depth(uint16_t depth) {
+	self.hot_depth = depth;
+}
 
-	// Get compile result status
-	int32_t success;
-	char infoLog[512];
-	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	if(!success) {
-		glGetProgramInfoLog(program, 512, NULL, infoLog);
-		glDeleteProgram(program);
-		printf("[ERROR] %s\n", infoLog);
-		return 0;
+void renderer_set_image(Image i) {
+	if (i.load) {
+		i = self.loads[i.load - 1].image;
 	}
+	// The atlas may have moved the image since it was handed out
+	if (i.region) {
+		i = atlas_region_image(i.region);
+	}
+	self.hot_image = i;
+	self.hot_uv[0] = i.u0;
+	self.hot_uv[1] = i.v0;
+	self.hot_uv[2] = i.u1 - i.u0;
+	self.hot_uv[3] = i.v1 - i.v0;
 
-	return program;
+	// Recorded quads take their slot when they are played
+	if (!self.sorting) {
+		use_texture(i.id);
+	}
+}
+
+Typeface renderer_load_font(const char *filename) {
+	if (self.glyphs.font_count == MAX_FONTS) {
+		system_panic("Too many fonts");
+	}
+	// NOTE: stb_truetype reads from the file data for as long as the font lives
+	const PackEntry *e = pack_find(&self.pack, filename);
+	uint8_t *data = e ? (uint8_t *)self.pack.data + e->offset : system_load_file(filename, NULL);
+	if (!data || !glyph_add_font(&self.glyphs, data)) {
+		system_panic("Couldn't load font");
+	}
+
+	if (!self.glyph_texture) {
+		glGenTextures(1, &self.glyph_texture);
+		bind_texture(0, self.glyph_texture);
+		texture_storage(GL_R8, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glyph_cache_init(&self.glyphs, store_glyph);
+
+		memset(self.layout_buckets, 0xFF, sizeof(self.layout_buckets));
+		for (int16_t i = 0; i < TEXT_LAYOUTS; i++) {
+			self.layouts[i].next = i + 1 < TEXT_LAYOUTS ? i + 1 : -1;
+		}
+		for (int16_t i = 0; i < TEXT_BLOCKS; i++) {
+			self.block_next[i] = i + 1 < TEXT_BLOCKS ? i + 1 : -1;
+		}
+		self.free_layout = 0;
+		self.free_block = 0;
+		self.free_blocks = TEXT_BLOCKS;
+	}
+	return (Typeface){ self.glyphs.font_count };
+}
+
+void renderer_draw_text(Typeface font, const char *text, float x, float y, float size) {
+	renderer_draw_text_wrapped(font, text, x, y, size, 0.f);
+}
+
+void renderer_draw_text_wrapped(Typeface font, const char *text, float x, float y, float size, float width) {
+	Image image = self.hot_image;
+	renderer_set_image((Image){
+		.id = self.glyph_texture, .width = GLYPH_ATLAS_SIZE, .height = GLYPH_ATLAS_SIZE,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f });
+
+	size_t length = strlen(text);
+	uint64_t hash = text_hash(font.id, text, length, size, width);
+	int16_t *bucket = &self.layout_buckets[hash % TEXT_BUCKETS];
+	int16_t found = *bucket;
+	while (found >= 0 && (self.layouts[found].hash != hash
+			|| !layout_matches(&self.layouts[found], font.id, text, length, size, width))) {
+		found = self.layouts[found].next;
+	}
+
+	if (found >= 0) {
+		self.stats.text_hits++;
+	}
+	else {
+		self.stats.text_misses++;
+		uint32_t count = glyph_layout(&self.glyphs, font.id, text, size, width);
+		if (count > TEXT_MAX_CACHED) {
+			draw_glyphs(font.id, self.glyphs.scratch, count, x, y);
+			renderer_set_image(image);
+			return;
+		}
+
+		uint32_t needed = (count + TEXT_BLOCK - 1) / TEXT_BLOCK;
+		while (self.free_layout < 0 || self.free_blocks < needed) {
+			layout_evict();
+		}
+		found = self.free_layout;
+		TextLayout *l = &self.layouts[found];
+		self.free_layout = l->next;
+		*l = (TextLayout){
+			.hash = hash, .text = malloc(length + 1), .length = length,
+			.font = font.id, .size = size, .width = width,
+			.glyph_count = count, .next = *bucket };
+		memcpy(l->text, text, length + 1);
+		*bucket = found;
+
+		int16_t *link = &l->first_block;
+		for (uint32_t i = 0; i < count; i += TEXT_BLOCK) {
+			int16_t b = self.free_block;
+			self.free_block = self.block_next[b];
+			uint32_t n = count - i < TEXT_BLOCK ? count - i : TEXT_BLOCK;
+			memcpy(self.blocks[b], self.glyphs.scratch + i, n * sizeof(LaidGlyph));
+			*link = b;
+			link = &self.block_next[b];
+		}
+		*link = -1;
+		self.free_blocks -= needed;
+	}
+
+	TextLayout *l = &self.layouts[found];
+	l->last_used = ++self.layout_tick;
+	int16_t b = l->first_block;
+	for (uint32_t i = 0; i < l->glyph_count; i += TEXT_BLOCK, b = self.block_next[b]) {
+		uint32_t n = l->glyph_count - i < TEXT_BLOCK ? l->glyph_count - i : TEXT_BLOCK;
+		draw_glyphs(font.id, self.blocks[b], n, x, y);
+	}
+
+	renderer_set_image(image);
+}
+
+Image renderer_load_image(const char *filename) {
+	Image img = load_image(filename);
+	if (!img.id) {
+		system_panic("Could't load image");
+	}
+	return img;
+}
+
+// Images from a file or the mounted pack, no image when the file can't be
+// read or decoded
+Image load_image(const char *filename) {
+	TRACE_BEGIN("renderer_load_image");
+	// Packed images were decoded when the pack was built
+	const PackEntry *e = pack_find(&self.pack, filename);
+	if (e && e->kind == PACK_PIXELS) {
+		Image img = pixels_image(e->width, e->height, self.pack.data + e->offset);
+		TRACE_END();
+		return img;
+	}
+
+	size_t size = 0;
+	uint8_t *file = NULL;
+	const uint8_t *data = e ? self.pack.data + e->offset : NULL;
+	if (e) {
+		size = e->size;
+	}
+	else {
+		data = file = system_load_file(filename, &size);
+	}
+	if (data == NULL) {
+		TRACE_END();
+		return (Image){ 0 };
+	}
+
+	// DDS and KTX2 files are uploaded as they are
+	TexFile tex;
+	if (texfile_parse(&tex, data, size)) {
+		Image img = compressed_image(&tex);
+		free(file);
+		TRACE_END();
+		return img;
+	}
+
+	int32_t w, h, n;
+	uint8_t *pixels = stbi_load_from_memory(data, size, &w, &h, &n, 4); // Force RGBA
+	free(file);
+	if (pixels == NULL) {
+		TRACE_END();
+		return (Image){ 0 };
+	}
+	Image img = pixels_image(w, h, pixels);
+	stbi_image_free(pixels);
+	TRACE_END();
+
+	return img;
+}
+
+bool renderer_mount_pack(const char *filename) {
+	size_t size = 0;
+	const void *data = system_map_file(filename, &size);
+	return data && pack_open(&self.pack, data, size);
+}
+
+// Small images go into the atlas, the rest get a texture of their own
+Image pixels_image(int32_t width, int32_t height, const uint8_t *pixels) {
+	Image img = { 0 };
+	if (width <= ATLAS_MAX_IMAGE && height <= ATLAS_MAX_IMAGE) {
+		img = atlas_add(width, height, pixels);
+	}
+	if (!img.id) {
+		img = renderer_mem_image(width, height, pixels);
+	}
+	return img;
+}
+
+Image renderer_load_image_async(const char *filename, uint32_t group) {
+	// Only the header is read here, so the size is known right away.
+	// Compressed textures have nothing to decode and load right away too,
+	// and packed pixels skip the workers to go straight to uploading.
+	int32_t w = 0, h = 0, n;
+	const PackEntry *e = pack_find(&self.pack, filename);
+	bool failed = false;
+	if (e ? e->kind != PACK_PIXELS : !stbi_info(filename, &w, &h, &n)) {
+		Image img = load_image(filename);
+		if (img.id) {
+			return img;
+		}
+		failed = true;
+	}
+
+	if (!self.load_mutex && !e && !failed) {
+		self.load_mutex = system_create_mutex();
+		self.load_signal = system_create_semaphore();
+		for (uint32_t t = 0; t < LOAD_THREADS; t++) {
+			system_create_thread(load_worker, NULL);
+		}
+	}
+
+	uint32_t l = 0;
+	while (l < MAX_LOADS && self.loads[l].state != LOAD_FREE) {
+		l++;
+	}
+	if (l == MAX_LOADS) {
+		system_panic("Too many images loading");
+	}
+
+	size_t length = strlen(filename) + 1;
+	ImageLoad *load = &self.loads[l];
+	*load = (ImageLoad){
+		.state = LOAD_QUEUED, .group = group, .filename = malloc(length) };
+	memcpy(load->filename, filename, length);
+	load->image = self.placeholder;
+	load->image.width = e ? e->width : w;
+	load->image.height = e ? e->height : h;
+
+	if (failed) {
+		load->state = LOAD_FAILED;
+	}
+	else if (e) {
+		load->state = LOAD_DECODED;
+		load->pixels = (uint8_t *)self.pack.data + e->offset;
+		load->mapped = true;
+		self.uploads[self.uploads_tail++ % MAX_LOADS] = l;
+	}
+	else {
+		system_lock(self.load_mutex);
+		self.load_jobs[self.jobs_tail++ % MAX_LOADS] = l;
+		system_unlock(self.load_mutex);
+		system_post(self.load_signal);
+	}
+	self.loads_pending += !failed;
+
+	Image img = load->image;
+	img.load = l + 1;
+	return img;
+}
+
+uint32_t renderer_images_pending(uint32_t group) {
+	uint32_t pending = 0;
+	for (uint32_t l = 0; l < MAX_LOADS; l++) {
+		ImageLoad *load = &self.loads[l];
+		if (load->group == group && !load->cancelled && (load->state == LOAD_QUEUED || load->state == LOAD_DECODED)) {
+			pending++;
+		}
+	}
+	return pending;
+}
+
+uint32_t renderer_images_failed(uint32_t group) {
+	uint32_t failed = 0;
+	for (uint32_t l = 0; l < MAX_LOADS; l++) {
+		ImageLoad *load = &self.loads[l];
+		if (load->group == group && load->state == LOAD_FAILED) {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+void renderer_wait_images(uint32_t group) {
+	for (;;) {
+		upload_loads(UINT32_MAX);
+		if (renderer_images_pending(group) == 0) {
+			return;
+		}
+		system_sleep(1);
+	}
+}
+
+void renderer_set_upload_budget(uint32_t bytes) {
+	self.upload_budget = bytes;
+}
+
+void renderer_free_image(Image i) {
+	if (i.load) {
+		ImageLoad *load = &self.loads[i.load - 1];
+		if (load->state == LOAD_QUEUED || load->state == LOAD_DECODED) {
+			load->cancelled = true;
+			return;
+		}
+		if (load->state == LOAD_READY) {
+			renderer_free_image(load->image);
+		}
+		free(load->filename);
+		*load = (ImageLoad){ 0 };
+		return;
+	}
+	if (i.region) {
+		atlas_free(i.region);
+		return;
+	}
+	forget_texture(i.id);
+	glDeleteTextures(1, &i.id);
+	// Recorded quads may still name the texture, their frame can't be kept
+	renderer_invalidate_frame();
+	for (uint32_t t = 0; t < MAX_TARGETS; t++) {
+		if (self.targets[t].texture == i.id) {
+			glDeleteFramebuffers(1, &self.targets[t].fbo);
+			self.targets[t] = (RenderTarget){ 0 };
+		}
+	}
+}
+
+Image renderer_mem_image(int32_t width, int32_t height, const uint8_t *pixels) {
+	return renderer_create_image(width, height, pixels, (TextureDesc){ 0 });
+}
+
+Image renderer_create_image(int32_t width, int32_t height, const uint8_t *pixels, TextureDesc desc) {
+	static const struct { GLenum internal, format; uint32_t bytes; GLint swizzle[4]; } formats[] = {
+		[TEXTURE_RGBA8] = { GL_RGBA8, GL_RGBA, 4, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } },
+		[TEXTURE_SRGB8_ALPHA8] = { GL_SRGB8_ALPHA8, GL_RGBA, 4, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } },
+		[TEXTURE_R8] = { GL_R8, GL_RED, 1, { GL_ONE, GL_ONE, GL_ONE, GL_RED } },
+		[TEXTURE_RG8] = { GL_RG8, GL_RG, 2, { GL_RED, GL_RED, GL_RED, GL_GREEN } },
+	};
+	static const GLint wraps[] = {
+		[WRAP_REPEAT] = GL_REPEAT,
+		[WRAP_CLAMP] = GL_CLAMP_TO_EDGE,
+		[WRAP_MIRROR] = GL_MIRRORED_REPEAT,
+	};
+	Image img = {
+		.id = 0, .width = width, .height = height,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f };
+
+	int32_t levels = 1;
+	if (desc.mips == MIPS_GENERATE) {
+		while ((width | height) >> levels) {
+			levels++;
+		}
+	}
+
+	glGenTextures(1, &img.id);
+	bind_texture(0, img.id);
+	texture_storage(formats[desc.format].internal, width, height, levels);
+	if (pixels) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, formats[desc.format].format, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		self.stats.texture_bytes += width * height * formats[desc.format].bytes;
+	}
+	if (levels > 1) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	GLint mag = desc.filter == FILTER_NEAREST ? GL_NEAREST : GL_LINEAR;
+	GLint min = mag;
+	if (levels > 1) {
+		min = desc.filter == FILTER_NEAREST ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wraps[desc.wrap]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wraps[desc.wrap]);
+	if (desc.format == TEXTURE_R8 || desc.format == TEXTURE_RG8) {
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, formats[desc.format].swizzle);
+	}
+	self.frame_dirty = true;
+
+	return img;
+}
+
+// Allocates the bound texture, immutable when the driver can. Either way
+// sampling stops at the last level allocated.
+void texture_storage(GLenum format, int32_t width, int32_t height, int32_t levels) {
+	if (self.tex_storage) {
+		glTexStorage2D(GL_TEXTURE_2D, levels, format, width, height);
+		return;
+	}
+
+	GLenum layout = format == GL_R8 ? GL_RED : format == GL_RG8 ? GL_RG : GL_RGBA;
+	for (int32_t l = 0; l < levels; l++) {
+		int32_t w = width >> l > 0 ? width >> l : 1;
+		int32_t h = height >> l > 0 ? height >> l : 1;
+		glTexImage2D(GL_TEXTURE_2D, l, format, w, h, 0, layout, GL_UNSIGNED_BYTE, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+Image compressed_image(const TexFile *t) {
+	static const GLenum formats[TEXFILE_FORMATS] = {
+		[TEXFILE_BC1] = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+		[TEXFILE_BC3] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+		[TEXFILE_BC7] = GL_COMPRESSED_RGBA_BPTC_UNORM,
+		[TEXFILE_ETC2_RGB] = GL_COMPRESSED_RGB8_ETC2,
+		[TEXFILE_ETC2_RGBA] = GL_COMPRESSED_RGBA8_ETC2_EAC,
+	};
+	Image img = {
+		.id = 0, .width = t->width, .height = t->height,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f };
+
+	glGenTextures(1, &img.id);
+	bind_texture(0, img.id);
+	uint8_t *pixels = NULL;
+	if (!self.compressed[t->format]) {
+		pixels = malloc((size_t)t->width * t->height * 4);
+	}
+	for (uint32_t l = 0; l < t->level_count; l++) {
+		int32_t w = t->width >> l > 0 ? t->width >> l : 1;
+		int32_t h = t->height >> l > 0 ? t->height >> l : 1;
+		if (pixels) {
+			texfile_decode(t, l, pixels);
+			glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			self.stats.texture_bytes += w * h * 4;
+		}
+		else {
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, formats[t->format], w, h, 0, t->levels[l].size, t->levels[l].data);
+			self.stats.texture_bytes += t->levels[l].size;
+		}
+	}
+	free(pixels);
+
+	// Files may stop short of the 1x1 level, the ones they have are used
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t->level_count - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, t->level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	self.frame_dirty = true;
+
+	return img;
+}
+
+Image renderer_create_target(int32_t width, int32_t height, bool cached) {
+	uint32_t t = 0;
+	while (t < MAX_TARGETS && self.targets[t].texture) {
+		t++;
+	}
+	if (t == MAX_TARGETS) {
+		system_panic("Too many render targets");
+	}
+
+	RenderTarget *target = &self.targets[t];
+	create_framebuffer(target, width, height);
+	target->cached = cached;
+	return (Image){
+		.id = target->texture, .width = width, .height = height,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f };
+}
+
+bool renderer_begin_target(Image image) {
+	assert(!self.target);
+	uint32_t t = 0;
+	while (t < MAX_TARGETS && self.targets[t].texture != image.id) {
+		t++;
+	}
+	assert(t < MAX_TARGETS);
+	RenderTarget *target = &self.targets[t];
+	if (target->cached && !target->dirty) {
+		self.stats.targets_cached++;
+		return false;
+	}
+	self.stats.targets_drawn++;
+
+	// Whatever was pushed so far goes to the window
+	flush(FLUSH_STATE);
+	self.target = t + 1;
+	self.window_proj_view = self.proj_view;
+	memcpy(self.window_view, self.view, sizeof(self.view));
+	self.window_transform = self.transform.m;
+	self.window_transform_kind = self.transform.kind;
+
+	// Upside down, so row 0 of the texture is the top like in any image
+	float w = (float)target->width;
+	float h = (float)target->height;
+	self.proj_view = math_mat4_ortho(0.f, w, 0.f, h, -1.f, 1.f);
+	self.view[0] = 0.f;
+	self.view[1] = 0.f;
+	self.view[2] = w;
+	self.view[3] = h;
+	self.transform.m = math_mat3x2_identity();
+	self.transform.kind = TRANSFORM_IDENTITY;
+
+	self.frame_dirty = true;
+	if (self.deferring) {
+		push_segment(SEGMENT_TARGET, t + 1, 0);
+	}
+	else {
+		bind_target(t + 1);
+	}
+	return true;
+}
+
+void renderer_end_target() {
+	assert(self.target);
+	flush(FLUSH_STATE);
+	self.targets[self.target - 1].dirty = false;
+	self.target = 0;
+
+	self.proj_view = self.window_proj_view;
+	memcpy(self.view, self.window_view, sizeof(self.view));
+	self.transform.m = self.window_transform;
+	self.transform.kind = self.window_transform_kind;
+	if (self.deferring) {
+		push_segment(SEGMENT_TARGET, 0, 0);
+	}
+	else {
+		bind_target(0);
+	}
+}
+
+// Points drawing at target `target` - 1, cleared, or back at the window
+// when it is 0
+void bind_target(uint32_t target) {
+	if (target) {
+		RenderTarget *t = &self.targets[target - 1];
+		glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+		glViewport(0, 0, t->width, t->height);
+		glClearColor(0.f, 0.f, 0.f, 0.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, self.window_fbo);
+		glViewport(0, 0, (GLsizei)self.view[2], (GLsizei)self.view[3]);
+	}
+}
+
+void create_framebuffer(RenderTarget *target, int32_t width, int32_t height) {
+	*target = (RenderTarget){ .width = width, .height = height, .dirty = true };
+	glGenTextures(1, &target->texture);
+	bind_texture(0, target->texture);
+	texture_storage(GL_RGBA8, width, height, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		system_panic("Couldn't create render target");
+	}
+	restore_framebuffer();
+}
+
+// Binds the framebuffer drawing goes to again, after code that had to
+// borrow the binding
+void restore_framebuffer() {
+	glBindFramebuffer(GL_FRAMEBUFFER, self.target ? self.targets[self.target - 1].fbo : self.window_fbo);
+}
+
+void renderer_invalidate_target(Image image) {
+	for (uint32_t t = 0; t < MAX_TARGETS; t++) {
+		if (self.targets[t].texture == image.id) {
+			self.targets[t].dirty = true;
+		}
+	}
+}
+
+void renderer_push_quad(float x1, float y1, float x2, float y2, float u0, float u1, float v0, float v1) {
+	// Texture coordinates are relative to the image, not its texture
+	Shape s = {
+		x1, y1, x2 - x1, 0.f, 0.f, y2 - y1,
+		self.hot_uv[0] + u0 * self.hot_uv[2], self.hot_uv[1] + v0 * self.hot_uv[3],
+		self.hot_uv[0] + u1 * self.hot_uv[2], self.hot_uv[1] + v1 * self.hot_uv[3],
+		self.hot_color };
+	submit(&s);
+}
+
+void renderer_push_quads(const Sprite *sprites, size_t count) {
+	if (self.sorting) {
+		for (size_t i = 0; i < count; i++) {
+			Shape s = sprite_shape(&sprites[i]);
+			submit(&s);
+		}
+		return;
+	}
+
+	while (count > 0) {
+		if (self.curr_quad >= MAX_QUADS) {
+			flush_batch(FLUSH_OVERFLOW);
+			stream_next_region();
+		}
+		uint32_t n = MAX_QUADS - self.curr_quad;
+		if (n > count) {
+			n = count;
+		}
+		Quad *q = &self.quads[self.curr_quad];
+		uint32_t written = 0;
+		switch (self.simd) {
+	#ifdef NEKO_SIMD_X86
+			case SIMD_AVX2: written = write_sprites_avx2(q, sprites, n); break;
+			case SIMD_SSE2: written = write_sprites_sse2(q, sprites, n); break;
+	#endif
+			default: written = write_sprites(q, sprites, n); break;
+		}
+		self.curr_quad += written;
+		self.stats.quads_drawn += written;
+		self.stats.quads_culled += n - written;
+		sprites += n;
+		count -= n;
+	}
+}
+
+void renderer_begin_static() {
+	// Nothing pushed before belongs to the batch
+	flush(FLUSH_STATE);
+	assert(!self.recording);
+	self.recording = true;
+	self.recording_culling = self.culling;
+	self.recording_sorting = self.sorting;
+	self.culling = false;
+	self.sorting = false;
+
+	// NOTE: never read back from the mapped ring, it is write only
+	if (!self.deferring) {
+		self.recording_from = self.curr_quad;
+		self.quads = self.staging;
+		self.curr_quad = 0;
+		self.first_quad = 0;
+		self.recorded_count = 0;
+		self.segment_count = 0;
+	}
+	self.static_quads = self.recorded_count;
+	self.static_segments = self.segment_count;
+}
+
+StaticBatch renderer_end_static() {
+	flush_batch(FLUSH_STATE);
+	self.recording = false;
+	self.culling = self.recording_culling;
+	self.sorting = self.recording_sorting;
+	if (!self.deferring) {
+		self.quads = self.mapped ? self.mapped + self.region * MAX_QUADS : self.staging;
+		self.curr_quad = self.recording_from;
+		self.first_quad = self.recording_from;
+	}
+
+	uint32_t id = 0;
+	while (id < MAX_STATIC_BATCHES && self.statics[id].vao) {
+		id++;
+	}
+	if (id == MAX_STATIC_BATCHES) {
+		system_panic("Too many static batches");
+	}
+
+	StaticData *b = &self.statics[id];
+	uint32_t count = self.recorded_count - self.static_quads;
+	create_batch_buffers(&b->vao, &b->vbo);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(Quad), self.recorded + self.static_quads, GL_STATIC_DRAW);
+	self.stats.vertex_bytes += count * sizeof(Quad);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	b->segment_count = self.segment_count - self.static_segments;
+	b->segments = malloc(b->segment_count * sizeof(Segment));
+	memcpy(b->segments, self.segments + self.static_segments, b->segment_count * sizeof(Segment));
+	for (uint32_t i = 0; i < b->segment_count; i++) {
+		if (b->segments[i].kind == SEGMENT_QUADS) {
+			b->segments[i].first -= self.static_quads;
+		}
+	}
+	self.recorded_count = self.static_quads;
+	self.segment_count = self.static_segments;
+	self.frame_dirty = true;
+	return (StaticBatch){ id + 1 };
+}
+
+void renderer_draw_static(StaticBatch batch) {
+	// Keeps the batch in order with what was pushed before it
+	flush(FLUSH_STATE);
+	StaticData *b = &self.statics[batch.id - 1];
+	mat4 proj_view = math_mat4_mul(math_mat4_from_mat3x2(self.transform.m), self.proj_view);
+	if (self.deferring) {
+		push_segment(SEGMENT_STATIC, batch.id - 1, 0)->proj_view = proj_view;
+		return;
+	}
+	draw_segments(b->vao, b->vbo, b->segments, b->segment_count, &proj_view);
+}
+
+void renderer_free_static(StaticBatch batch) {
+	flush_now(FLUSH_STATE);
+	StaticData *b = &self.statics[batch.id - 1];
+	glDeleteVertexArrays(1, &b->vao);
+	glDeleteBuffers(1, &b->vbo);
+	free(b->segments);
+	*b = (StaticData){ 0 };
+	self.frame_dirty = true;
+}
+
+// Vertex array and buffer for recorded quads, they share the quad indices
+void create_batch_buffers(uint32_t *vao, uint32_t *vbo) {
+	glGenVertexArrays(1, vao);
+	glBindVertexArray(*vao);
+	glGenBuffers(1, vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+	enable_attributes();
+#ifndef NEKO_INSTANCED
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self.ebo);
+#endif
+	glBindVertexArray(0);
+}
+
+// Draws recorded segments out of `vao`, with `proj_view` or else the
+// projection each segment was recorded with. Only static batches pass
+// `proj_view`, the quads of a recorded frame were counted when pushed.
+void draw_segments(uint32_t vao, uint32_t vbo, const Segment *segments, uint32_t count, const mat4 *proj_view) {
+	use_shader(self.shader);
+	BlendMode blend = self.blend;
+	for (uint32_t i = 0; i < count; i++) {
+		const Segment *s = &segments[i];
+		if (s->kind == SEGMENT_STATIC) {
+			StaticData *b = &self.statics[s->first];
+			draw_segments(b->vao, b->vbo, b->segments, b->segment_count, &s->proj_view);
+			continue;
+		}
+		if (s->kind == SEGMENT_TARGET) {
+			bind_target(s->first);
+			continue;
+		}
+
+		glBindVertexArray(vao);
+		glUniformMatrix4fv(self.proj_view_loc, 1, GL_TRUE, proj_view ? &proj_view->m0 : &s->proj_view.m0);
+		bind_slots(s->slots, s->slot_count);
+		if (s->blend != blend) {
+			blend = s->blend;
+			blend_func(blend);
+		}
+#ifdef NEKO_INSTANCED
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		setup_attributes(s->first * sizeof(Quad));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, s->count);
+#else
+		(void)vbo;
+		glDrawElementsBaseVertex(GL_TRIANGLES, s->count * 6, GL_UNSIGNED_INT, 0, s->first * 4);
+#endif
+		self.stats.draw_calls++;
+		self.stats.vertices += s->count * 4;
+		if (proj_view) {
+			self.stats.quads_drawn += s->count;
+		}
+	}
+	if (blend != self.blend) {
+		blend_func(self.blend);
+	}
+}
+
+// Adds a segment to what is being recorded with the current state
+Segment *push_segment(SegmentKind kind, uint32_t first, uint32_t count) {
+	if (self.segment_count == self.segment_size) {
+		self.segment_size = self.segment_size ? self.segment_size * 2 : 64;
+		self.segments = realloc(self.segments, self.segment_size * sizeof(Segment));
+	}
+	Segment *s = &self.segments[self.segment_count++];
+	*s = (Segment){
+		.kind = kind, .first = first, .count = count,
+		.slot_count = self.slot_count, .blend = self.blend, .proj_view = self.proj_view };
+	memcpy(s->slots, self.slots, self.slot_count * sizeof(uint32_t));
+	return s;
+}
+
+// Moves the quads of a flush into what is being recorded
+void record_batch(uint32_t count) {
+	if (self.recorded_count + count > self.recorded_size) {
+		while (self.recorded_count + count > self.recorded_size) {
+			self.recorded_size = self.recorded_size ? self.recorded_size * 2 : MAX_QUADS;
+		}
+		self.recorded = realloc(self.recorded, self.recorded_size * sizeof(Quad));
+	}
+	memcpy(self.recorded + self.recorded_count, self.quads + self.first_quad, count * sizeof(Quad));
+	push_segment(SEGMENT_QUADS, self.recorded_count, count);
+	self.recorded_count += count;
+}
+
+SimdLevel renderer_set_simd(SimdLevel level) {
+#ifdef NEKO_SIMD_X86
+	__builtin_cpu_init();
+	if (level == SIMD_AVX2 && !__builtin_cpu_supports("avx2")) {
+		level = SIMD_SSE2;
+	}
+	if (level == SIMD_SSE2 && !__builtin_cpu_supports("sse2")) {
+		level = SIMD_NONE;
+	}
+#else
+	level = SIMD_NONE;
+#endif
+	self.simd = level;
+	return level;
+}
+
+// Sprite as a quad relative to the current image, not transformed yet
+Shape sprite_shape(const Sprite *sp) {
+	return (Shape){
+		sp->x, sp->y, sp->w, 0.f, 0.f, sp->h,
+		self.hot_uv[0] + sp->u0 * self.hot_uv[2], self.hot_uv[1] + sp->v0 * self.hot_uv[3],
+		self.hot_uv[0] + sp->u1 * self.hot_uv[2], self.hot_uv[1] + sp->v1 * self.hot_uv[3],
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+		pack_color(sp->color) };
+#else
+		sp->color };
+#endif
+}
+
+// Transforms a quad and either records it or streams it right away
+void submit(Shape *s) {
+	transform_quad(&self.transform, &s->x);
+	if (self.culling && !shape_visible(s)) {
+		self.stats.quads_culled++;
+		return;
+	}
+	self.stats.quads_drawn++;
+
+	if (!self.sorting) {
+		emit(s);
+		return;
+	}
+
+	if (self.command_count == MAX_COMMANDS) {
+		flush(FLUSH_OVERFLOW);
+	}
+	uint32_t i = self.command_count++;
+	self.commands[i] = (Command){ *s, self.hot_image.id, self.hot_blend };
+	self.keys[i] = (uint64_t)self.hot_layer << 56
+		| (uint64_t)self.hot_depth << 40
+		| (uint64_t)self.hot_blend << 36
+		| (uint64_t)(self.hot_image.id & 0xFFFF) << 16
+		| i;
+}
+
+// Whether a transformed quad overlaps the view at all
+bool shape_visible(const Shape *s) {
+	return quad_in_view(&s->x, self.view);
+}
+
+// Writes a quad into the vertex ring with the current texture slot
+void emit(const Shape *s) {
+	if (self.curr_quad >= MAX_QUADS) {
+		flush_batch(FLUSH_OVERFLOW);
+		stream_next_region();
+	}
+
+	write_quad(&self.quads[self.curr_quad++], s);
+}
+
+void write_quad(Quad *q, const Shape *s) {
+#ifdef NEKO_INSTANCED
+	*q = (Quad) {
+		s->x, s->y, s->ax, s->ay, s->bx, s->by, s->color,
+		unorm_uv(s->u0, self.hot_slot & 1), unorm_uv(s->v0, self.hot_slot >> 1 & 1),
+		unorm_uv(s->u1, self.hot_slot >> 2 & 1), unorm_uv(s->v1, self.hot_slot >> 3 & 1) };
+#else
+	float cx = s->x + s->ax;
+	float cy = s->y + s->ay;
+	q->v[0] = make_v(s->x, s->y, s->u0, s->v0, s->color);
+	q->v[1] = make_v(cx, cy, s->u1, s->v0, s->color);
+	q->v[2] = make_v(cx + s->bx, cy + s->by, s->u1, s->v1, s->color);
+	q->v[3] = make_v(s->x + s->bx, s->y + s->by, s->u0, s->v1, s->color);
+#endif
+}
+
+// Sprites straight into the vertex ring, the `n` quads must fit in the
+// current region. Returns how many survived culling, the SIMD versions
+// below must write the very same bytes.
+uint32_t write_sprites(Quad *q, const Sprite *s, uint32_t n) {
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		Shape shape = sprite_shape(&s[i]);
+		transform_quad(&self.transform, &shape.x);
+		if (!self.culling || shape_visible(&shape)) {
+			write_quad(&q[written++], &shape);
+		}
+	}
+	return written;
+}
+
+#ifdef NEKO_SIMD_X86
+// NOTE(ellora): The kernels load 4 (or 8) sprites and transpose them so each
+// register holds one field of all of them. They do the math, then
+// transpose back into the layout of the build. Sprites left over that
+// don't fill a register go through write_sprites.
+
+#define SSE2 __attribute__((target("sse2"), always_inline)) static inline
+#define AVX2 __attribute__((target("avx2"), always_inline)) static inline
+
+SSE2 void store_rows4(void *dst, size_t stride, __m128 r0, __m128 r1, __m128 r2, __m128 r3) {
+	uint8_t *p = dst;
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps((float*)(p + 0 * stride), r0);
+	_mm_storeu_ps((float*)(p + 1 * stride), r1);
+	_mm_storeu_ps((float*)(p + 2 * stride), r2);
+	_mm_storeu_ps((float*)(p + 3 * stride), r3);
+}
+
+SSE2 void store_lanes4(void *dst, size_t stride, __m128 r) {
+	uint8_t *p = dst;
+	_mm_store_ss((float*)(p + 0 * stride), r);
+	_mm_store_ss((float*)(p + 1 * stride), _mm_shuffle_ps(r, r, 1));
+	_mm_store_ss((float*)(p + 2 * stride), _mm_shuffle_ps(r, r, 2));
+	_mm_store_ss((float*)(p + 3 * stride), _mm_shuffle_ps(r, r, 3));
+}
+
+SSE2 void store_pairs4(void *dst, size_t stride, __m128 r0, __m128 r1) {
+	uint8_t *p = dst;
+	__m128 lo = _mm_unpacklo_ps(r0, r1);
+	__m128 hi = _mm_unpackhi_ps(r0, r1);
+	_mm_storel_pi((__m64*)(p + 0 * stride), lo);
+	_mm_storeh_pi((__m64*)(p + 1 * stride), lo);
+	_mm_storel_pi((__m64*)(p + 2 * stride), hi);
+	_mm_storeh_pi((__m64*)(p + 3 * stride), hi);
+}
+
+SSE2 __m128i unorm8x4(__m128 f) {
+	f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(1.f));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(255.f)), _mm_set1_ps(.5f)));
+}
+
+SSE2 __m128 pack_color4(__m128 r, __m128 g, __m128 b, __m128 a) {
+	__m128i rgba = _mm_or_si128(
+		_mm_or_si128(unorm8x4(r), _mm_slli_epi32(unorm8x4(g), 8)),
+		_mm_or_si128(_mm_slli_epi32(unorm8x4(b), 16), _mm_slli_epi32(unorm8x4(a), 24)));
+	return _mm_castsi128_ps(rgba);
+}
+
+#ifdef UV_SLOT_BITS
+// Lanes of u, v pairs as unorm_uv writes them, `bits` from slot_pair
+SSE2 __m128 pack_uv4(__m128 u, __m128 v, __m128i bits) {
+	__m128 one = _mm_set1_ps(1.f);
+	u = _mm_min_ps(_mm_max_ps(u, _mm_setzero_ps()), one);
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), one);
+	__m128 scale = _mm_set1_ps((float)UV_MAX);
+	__m128 half = _mm_set1_ps(.5f);
+	__m128i iu = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(u, scale), half));
+	__m128i iv = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+	__m128i uv = _mm_or_si128(_mm_slli_epi32(iu, UV_SLOT_BITS), _mm_slli_epi32(iv, 16 + UV_SLOT_BITS));
+	return _mm_castsi128_ps(_mm_or_si128(uv, bits));
+}
+#endif
+
+// Lanes whose quad bounds overlap the view, as shape_visible
+SSE2 int32_t visible4(__m128 x, __m128 y, __m128 ax, __m128 ay, __m128 bx, __m128 by,
+		__m128 vx0, __m128 vy0, __m128 vx1, __m128 vy1) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 x0 = _mm_add_ps(_mm_add_ps(x, _mm_min_ps(ax, zero)), _mm_min_ps(bx, zero));
+	__m128 x1 = _mm_add_ps(_mm_add_ps(x, _mm_max_ps(ax, zero)), _mm_max_ps(bx, zero));
+	__m128 y0 = _mm_add_ps(_mm_add_ps(y, _mm_min_ps(ay, zero)), _mm_min_ps(by, zero));
+	__m128 y1 = _mm_add_ps(_mm_add_ps(y, _mm_max_ps(ay, zero)), _mm_max_ps(by, zero));
+	__m128 in = _mm_and_ps(
+		_mm_and_ps(_mm_cmpgt_ps(x1, vx0), _mm_cmplt_ps(x0, vx1)),
+		_mm_and_ps(_mm_cmpgt_ps(y1, vy0), _mm_cmplt_ps(y0, vy1)));
+	return _mm_movemask_ps(in);
+}
+
+__attribute__((target("sse2")))
+uint32_t write_sprites_sse2(Quad *q, const Sprite *s, uint32_t n) {
+	const mat3x2 *m = &self.transform.m;
+	__m128 ma = _mm_set1_ps(m->a), mb = _mm_set1_ps(m->b);
+	__m128 mc = _mm_set1_ps(m->c), md = _mm_set1_ps(m->d);
+	__m128 mtx = _mm_set1_ps(m->tx), mty = _mm_set1_ps(m->ty);
+	__m128 hu = _mm_set1_ps(self.hot_uv[0]), hv = _mm_set1_ps(self.hot_uv[1]);
+	__m128 hdu = _mm_set1_ps(self.hot_uv[2]), hdv = _mm_set1_ps(self.hot_uv[3]);
+	uint32_t slot = self.hot_slot;
+	bool culling = self.culling;
+	__m128 vx0 = _mm_set1_ps(self.view[0]), vy0 = _mm_set1_ps(self.view[1]);
+	__m128 vx1 = _mm_set1_ps(self.view[2]), vy1 = _mm_set1_ps(self.view[3]);
+	Quad culled[4];
+
+	uint32_t i = 0, written = 0;
+	for (; i + 4 <= n; i += 4) {
+		const Sprite *sp = &s[i];
+
+		__m128 x = _mm_loadu_ps(&sp[0].x);
+		__m128 y = _mm_loadu_ps(&sp[1].x);
+		__m128 w = _mm_loadu_ps(&sp[2].x);
+		__m128 h = _mm_loadu_ps(&sp[3].x);
+		_MM_TRANSPOSE4_PS(x, y, w, h);
+		__m128 u0 = _mm_loadu_ps(&sp[0].u0);
+		__m128 v0 = _mm_loadu_ps(&sp[1].u0);
+		__m128 u1 = _mm_loadu_ps(&sp[2].u0);
+		__m128 v1 = _mm_loadu_ps(&sp[3].u0);
+		_MM_TRANSPOSE4_PS(u0, v0, u1, v1);
+
+		__m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ma, x), _mm_mul_ps(mc, y)), mtx);
+		__m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mb, x), _mm_mul_ps(md, y)), mty);
+		__m128 ax = _mm_mul_ps(ma, w);
+		__m128 ay = _mm_mul_ps(mb, w);
+		__m128 bx = _mm_mul_ps(mc, h);
+		__m128 by = _mm_mul_ps(md, h);
+		u0 = _mm_add_ps(hu, _mm_mul_ps(u0, hdu));
+		v0 = _mm_add_ps(hv, _mm_mul_ps(v0, hdv));
+		u1 = _mm_add_ps(hu, _mm_mul_ps(u1, hdu));
+		v1 = _mm_add_ps(hv, _mm_mul_ps(v1, hdv));
+
+		// Quads partly in view are written aside and then compacted
+		int32_t visible = 0xF;
+		if (culling) {
+			visible = visible4(px, py, ax, ay, bx, by, vx0, vy0, vx1, vy1);
+			if (!visible) {
+				continue;
+			}
+		}
+		Quad *dst = visible == 0xF ? &q[written] : culled;
+
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+		__m128 r = _mm_loadu_ps(&sp[0].color.r);
+		__m128 g = _mm_loadu_ps(&sp[1].color.r);
+		__m128 b = _mm_loadu_ps(&sp[2].color.r);
+		__m128 a = _mm_loadu_ps(&sp[3].color.r);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+		__m128 rgba = pack_color4(r, g, b, a);
+#endif
+
+#ifdef NEKO_INSTANCED
+		__m128i bits0 = _mm_set1_epi32(slot_pair(slot, 0));
+		__m128i bits1 = _mm_set1_epi32(slot_pair(slot, 2 * UV_SLOT_BITS));
+		store_rows4(&dst->x, sizeof(Quad), px, py, ax, ay);
+		store_rows4(&dst->bx, sizeof(Quad), bx, by, rgba, pack_uv4(u0, v0, bits0));
+		store_lanes4(&dst->u1, sizeof(Quad), pack_uv4(u1, v1, bits1));
+#else
+		__m128 x1 = _mm_add_ps(px, ax);
+		__m128 y1 = _mm_add_ps(py, ay);
+		__m128 x2 = _mm_add_ps(x1, bx);
+		__m128 y2 = _mm_add_ps(y1, by);
+		__m128 x3 = _mm_add_ps(px, bx);
+		__m128 y3 = _mm_add_ps(py, by);
+#ifdef NEKO_PACKED_VERTEX
+		__m128i bits = _mm_set1_epi32(slot_pair(slot, 0));
+		store_rows4(&dst->v[0].x, sizeof(Quad), px, py, rgba, pack_uv4(u0, v0, bits));
+		store_rows4(&dst->v[1].x, sizeof(Quad), x1, y1, rgba, pack_uv4(u1, v0, bits));
+		store_rows4(&dst->v[2].x, sizeof(Quad), x2, y2, rgba, pack_uv4(u1, v1, bits));
+		store_rows4(&dst->v[3].x, sizeof(Quad), x3, y3, rgba, pack_uv4(u0, v1, bits));
+#else
+		store_pairs4(&dst->v[0].x, sizeof(Quad), px, py);
+		store_pairs4(&dst->v[1].x, sizeof(Quad), x1, y1);
+		store_pairs4(&dst->v[2].x, sizeof(Quad), x2, y2);
+		store_pairs4(&dst->v[3].x, sizeof(Quad), x3, y3);
+		store_pairs4(&dst->v[0].u, sizeof(Quad), u0, v0);
+		store_pairs4(&dst->v[1].u, sizeof(Quad), u1, v0);
+		store_pairs4(&dst->v[2].u, sizeof(Quad), u1, v1);
+		store_pairs4(&dst->v[3].u, sizeof(Quad), u0, v1);
+
+		// Float colors are the same for the four corners, as they were loaded
+		for (int32_t k = 0; k < 4; k++) {
+			__m128 rgba = _mm_loadu_ps(&sp[k].color.r);
+			for (int32_t c = 0; c < 4; c++) {
+				_mm_storeu_ps(&dst[k].v[c].r, rgba);
+				dst[k].v[c].slot = slot;
+			}
+		}
+#endif
+#endif
+		if (dst == culled) {
+			for (int32_t k = 0; k < 4; k++) {
+				if (visible & (1 << k)) {
+					q[written++] = culled[k];
+				}
+			}
+		}
+		else {
+			written += 4;
+		}
+	}
+	return written + write_sprites(q + written, s + i, n - i);
+}
+
+// The 8 wide versions work on two sets of 4 at once, the low half of every
+// register holds sprites 0 to 3 and the high half sprites 4 to 7.
+#define TRANSPOSE8(r0, r1, r2, r3) do { \
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1); \
+		__m256 t1 = _mm256_unpacklo_ps(r2, r3); \
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1); \
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3); \
+		r0 = _mm256_shuffle_ps(t0, t1, 0x44); \
+		r1 = _mm256_shuffle_ps(t0, t1, 0xEE); \
+		r2 = _mm256_shuffle_ps(t2, t3, 0x44); \
+		r3 = _mm256_shuffle_ps(t2, t3, 0xEE); \
+	} while (0)
+
+AVX2 __m256 load_pair8(const float *lo, const float *hi) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+}
+
+AVX2 void store_rows8(void *dst, size_t stride, __m256 r0, __m256 r1, __m256 r2, __m256 r3) {
+	uint8_t *p = dst;
+	TRANSPOSE8(r0, r1, r2, r3);
+	_mm_storeu_ps((float*)(p + 0 * stride), _mm256_castps256_ps128(r0));
+	_mm_storeu_ps((float*)(p + 1 * stride), _mm256_castps256_ps128(r1));
+	_mm_storeu_ps((float*)(p + 2 * stride), _mm256_castps256_ps128(r2));
+	_mm_storeu_ps((float*)(p + 3 * stride), _mm256_castps256_ps128(r3));
+	_mm_storeu_ps((float*)(p + 4 * stride), _mm256_extractf128_ps(r0, 1));
+	_mm_storeu_ps((float*)(p + 5 * stride), _mm256_extractf128_ps(r1, 1));
+	_mm_storeu_ps((float*)(p + 6 * stride), _mm256_extractf128_ps(r2, 1));
+	_mm_storeu_ps((float*)(p + 7 * stride), _mm256_extractf128_ps(r3, 1));
+}
+
+AVX2 void store_lanes8(void *dst, size_t stride, __m256 r) {
+	uint8_t *p = dst;
+	store_lanes4(p, stride, _mm256_castps256_ps128(r));
+	store_lanes4(p + 4 * stride, stride, _mm256_extractf128_ps(r, 1));
+}
+
+AVX2 void store_pairs8(void *dst, size_t stride, __m256 r0, __m256 r1) {
+	uint8_t *p = dst;
+	store_pairs4(p, stride, _mm256_castps256_ps128(r0), _mm256_castps256_ps128(r1));
+	store_pairs4(p + 4 * stride, stride, _mm256_extractf128_ps(r0, 1), _mm256_extractf128_ps(r1, 1));
+}
+
+AVX2 __m256i unorm8x8(__m256 f) {
+	f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+	return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(f, _mm256_set1_ps(255.f)), _mm256_set1_ps(.5f)));
+}
+
+AVX2 __m256 pack_color8(__m256 r, __m256 g, __m256 b, __m256 a) {
+	__m256i rgba = _mm256_or_si256(
+		_mm256_or_si256(unorm8x8(r), _mm256_slli_epi32(unorm8x8(g), 8)),
+		_mm256_or_si256(_mm256_slli_epi32(unorm8x8(b), 16), _mm256_slli_epi32(unorm8x8(a), 24)));
+	return _mm256_castsi256_ps(rgba);
+}
+
+#ifdef UV_SLOT_BITS
+AVX2 __m256 pack_uv8(__m256 u, __m256 v, __m256i bits) {
+	__m256 one = _mm256_set1_ps(1.f);
+	u = _mm256_min_ps(_mm256_max_ps(u, _mm256_setzero_ps()), one);
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), one);
+	__m256 scale = _mm256_set1_ps((float)UV_MAX);
+	__m256 half = _mm256_set1_ps(.5f);
+	__m256i iu = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(u, scale), half));
+	__m256i iv = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+	__m256i uv = _mm256_or_si256(_mm256_slli_epi32(iu, UV_SLOT_BITS), _mm256_slli_epi32(iv, 16 + UV_SLOT_BITS));
+	return _mm256_castsi256_ps(_mm256_or_si256(uv, bits));
+}
+#endif
+
+AVX2 int32_t visible8(__m256 x, __m256 y, __m256 ax, __m256 ay, __m256 bx, __m256 by,
+		__m256 vx0, __m256 vy0, __m256 vx1, __m256 vy1) {
+	__m256 zero = _mm256_setzero_ps();
+	__m256 x0 = _mm256_add_ps(_mm256_add_ps(x, _mm256_min_ps(ax, zero)), _mm256_min_ps(bx, zero));
+	__m256 x1 = _mm256_add_ps(_mm256_add_ps(x, _mm256_max_ps(ax, zero)), _mm256_max_ps(bx, zero));
+	__m256 y0 = _mm256_add_ps(_mm256_add_ps(y, _mm256_min_ps(ay, zero)), _mm256_min_ps(by, zero));
+	__m256 y1 = _mm256_add_ps(_mm256_add_ps(y, _mm256_max_ps(ay, zero)), _mm256_max_ps(by, zero));
+	__m256 in = _mm256_and_ps(
+		_mm256_and_ps(_mm256_cmp_ps(x1, vx0, _CMP_GT_OQ), _mm256_cmp_ps(x0, vx1, _CMP_LT_OQ)),
+		_mm256_and_ps(_mm256_cmp_ps(y1, vy0, _CMP_GT_OQ), _mm256_cmp_ps(y0, vy1, _CMP_LT_OQ)));
+	return _mm256_movemask_ps(in);
+}
+
+__attribute__((target("avx2")))
+uint32_t write_sprites_avx2(Quad *q, const Sprite *s, uint32_t n) {
+	const mat3x2 *m = &self.transform.m;
+	__m256 ma = _mm256_set1_ps(m->a), mb = _mm256_set1_ps(m->b);
+	__m256 mc = _mm256_set1_ps(m->c), md = _mm256_set1_ps(m->d);
+	__m256 mtx = _mm256_set1_ps(m->tx), mty = _mm256_set1_ps(m->ty);
+	__m256 hu = _mm256_set1_ps(self.hot_uv[0]), hv = _mm256_set1_ps(self.hot_uv[1]);
+	__m256 hdu = _mm256_set1_ps(self.hot_uv[2]), hdv = _mm256_set1_ps(self.hot_uv[3]);
+	uint32_t slot = self.hot_slot;
+	bool culling = self.culling;
+	__m256 vx0 = _mm256_set1_ps(self.view[0]), vy0 = _mm256_set1_ps(self.view[1]);
+	__m256 vx1 = _mm256_set1_ps(self.view[2]), vy1 = _mm256_set1_ps(self.view[3]);
+	Quad culled[8];
+
+	uint32_t i = 0, written = 0;
+	for (; i + 8 <= n; i += 8) {
+		const Sprite *sp = &s[i];
+
+		__m256 x = load_pair8(&sp[0].x, &sp[4].x);
+		__m256 y = load_pair8(&sp[1].x, &sp[5].x);
+		__m256 w = load_pair8(&sp[2].x, &sp[6].x);
+		__m256 h = load_pair8(&sp[3].x, &sp[7].x);
+		TRANSPOSE8(x, y, w, h);
+		__m256 u0 = load_pair8(&sp[0].u0, &sp[4].u0);
+		__m256 v0 = load_pair8(&sp[1].u0, &sp[5].u0);
+		__m256 u1 = load_pair8(&sp[2].u0, &sp[6].u0);
+		__m256 v1 = load_pair8(&sp[3].u0, &sp[7].u0);
+		TRANSPOSE8(u0, v0, u1, v1);
+
+		__m256 px = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ma, x), _mm256_mul_ps(mc, y)), mtx);
+		__m256 py = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mb, x), _mm256_mul_ps(md, y)), mty);
+		__m256 ax = _mm256_mul_ps(ma, w);
+		__m256 ay = _mm256_mul_ps(mb, w);
+		__m256 bx = _mm256_mul_ps(mc, h);
+		__m256 by = _mm256_mul_ps(md, h);
+		u0 = _mm256_add_ps(hu, _mm256_mul_ps(u0, hdu));
+		v0 = _mm256_add_ps(hv, _mm256_mul_ps(v0, hdv));
+		u1 = _mm256_add_ps(hu, _mm256_mul_ps(u1, hdu));
+		v1 = _mm256_add_ps(hv, _mm256_mul_ps(v1, hdv));
+
+		// Quads partly in view are written aside and then compacted
+		int32_t visible = 0xFF;
+		if (culling) {
+			visible = visible8(px, py, ax, ay, bx, by, vx0, vy0, vx1, vy1);
+			if (!visible) {
+				continue;
+			}
+		}
+		Quad *dst = visible == 0xFF ? &q[written] : culled;
+
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+		__m256 r = load_pair8(&sp[0].color.r, &sp[4].color.r);
+		__m256 g = load_pair8(&sp[1].color.r, &sp[5].color.r);
+		__m256 b = load_pair8(&sp[2].color.r, &sp[6].color.r);
+		__m256 a = load_pair8(&sp[3].color.r, &sp[7].color.r);
+		TRANSPOSE8(r, g, b, a);
+		__m256 rgba = pack_color8(r, g, b, a);
+#endif
+
+#ifdef NEKO_INSTANCED
+		__m256i bits0 = _mm256_set1_epi32(slot_pair(slot, 0));
+		__m256i bits1 = _mm256_set1_epi32(slot_pair(slot, 2 * UV_SLOT_BITS));
+		store_rows8(&dst->x, sizeof(Quad), px, py, ax, ay);
+		store_rows8(&dst->bx, sizeof(Quad), bx, by, rgba, pack_uv8(u0, v0, bits0));
+		store_lanes8(&dst->u1, sizeof(Quad), pack_uv8(u1, v1, bits1));
+#else
+		__m256 x1 = _mm256_add_ps(px, ax);
+		__m256 y1 = _mm256_add_ps(py, ay);
+		__m256 x2 = _mm256_add_ps(x1, bx);
+		__m256 y2 = _mm256_add_ps(y1, by);
+		__m256 x3 = _mm256_add_ps(px, bx);
+		__m256 y3 = _mm256_add_ps(py, by);
+#ifdef NEKO_PACKED_VERTEX
+		__m256i bits = _mm256_set1_epi32(slot_pair(slot, 0));
+		store_rows8(&dst->v[0].x, sizeof(Quad), px, py, rgba, pack_uv8(u0, v0, bits));
+		store_rows8(&dst->v[1].x, sizeof(Quad), x1, y1, rgba, pack_uv8(u1, v0, bits));
+		store_rows8(&dst->v[2].x, sizeof(Quad), x2, y2, rgba, pack_uv8(u1, v1, bits));
+		store_rows8(&dst->v[3].x, sizeof(Quad), x3, y3, rgba, pack_uv8(u0, v1, bits));
+#else
+		store_pairs8(&dst->v[0].x, sizeof(Quad), px, py);
+		store_pairs8(&dst->v[1].x, sizeof(Quad), x1, y1);
+		store_pairs8(&dst->v[2].x, sizeof(Quad), x2, y2);
+		store_pairs8(&dst->v[3].x, sizeof(Quad), x3, y3);
+		store_pairs8(&dst->v[0].u, sizeof(Quad), u0, v0);
+		store_pairs8(&dst->v[1].u, sizeof(Quad), u1, v0);
+		store_pairs8(&dst->v[2].u, sizeof(Quad), u1, v1);
+		store_pairs8(&dst->v[3].u, sizeof(Quad), u0, v1);
+		for (int32_t k = 0; k < 8; k++) {
+			__m128 rgba = _mm_loadu_ps(&sp[k].color.r);
+			for (int32_t c = 0; c < 4; c++) {
+				_mm_storeu_ps(&dst[k].v[c].r, rgba);
+				dst[k].v[c].slot = slot;
+			}
+		}
+#endif
+#endif
+		if (dst == culled) {
+			for (int32_t k = 0; k < 8; k++) {
+				if (visible & (1 << k)) {
+					q[written++] = culled[k];
+				}
+			}
+		}
+		else {
+			written += 8;
+		}
+	}
+	return written + write_sprites(q + written, s + i, n - i);
+}
+
+#undef TRANSPOSE8
+#undef SSE2
+#undef AVX2
+#endif
+
+// Sorts the recorded quads and streams them, state changes only flush when
+// a blend mode changes or the texture slots run out.
+void play_commands() {
+	uint32_t count = self.command_count;
+	self.command_count = 0;
+	sort_keys(self.keys, self.sort_tmp, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		const Command *c = &self.commands[self.keys[i] & 0xFFFF];
+		apply_blend(c->blend);
+		uint32_t slot = self.hot_slot;
+		if (slot >= self.slot_count || self.slots[slot] != c->texture) {
+			use_texture(c->texture);
+		}
+		emit(&c->shape);
+	}
+}
+
+// Points the attributes at the quads starting `offset` bytes into the
+// vertex buffer, the instanced path does it on every flush because it has
+// no base vertex to shift the draw.
+void setup_attributes(uintptr_t offset) {
+#ifdef NEKO_INSTANCED
+	glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(Quad), (void*)(offset + offsetof(Quad, x)));
+	glVertexAttribPointer(ATTRIB_AXES, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (void*)(offset + offsetof(Quad, ax)));
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Quad), (void*)(offset + offsetof(Quad, color)));
+	glVertexAttribIPointer(ATTRIB_TEXCOORDS, 4, GL_UNSIGNED_SHORT, sizeof(Quad), (void*)(offset + offsetof(Quad, u0)));
+#else
+	glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offset + offsetof(Vertex, x)));
+#ifdef NEKO_PACKED_VERTEX
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offset + offsetof(Vertex, color)));
+	glVertexAttribIPointer(ATTRIB_TEXCOORDS, 2, GL_UNSIGNED_SHORT, sizeof(Vertex), (void*)(offset + offsetof(Vertex, u)));
+#else
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offset + offsetof(Vertex, r)));
+	glVertexAttribPointer(ATTRIB_TEXCOORDS, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offset + offsetof(Vertex, u)));
+	glVertexAttribIPointer(ATTRIB_SLOT, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)(offset + offsetof(Vertex, slot)));
+#endif
+#endif
+}
+
+void enable_attributes() {
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glEnableVertexAttribArray(ATTRIB_COLOR);
+	glEnableVertexAttribArray(ATTRIB_TEXCOORDS);
+#if !defined(NEKO_INSTANCED) && !defined(NEKO_PACKED_VERTEX)
+	// The packed layouts carry the slot in the texture coordinates
+	glEnableVertexAttribArray(ATTRIB_SLOT);
+#endif
+	setup_attributes(0);
+
+#ifdef NEKO_INSTANCED
+	// Every attribute advances once per quad, there are no indices at all
+	glEnableVertexAttribArray(ATTRIB_AXES);
+	glVertexAttribDivisor(ATTRIB_POSITION, 1);
+	glVertexAttribDivisor(ATTRIB_COLOR, 1);
+	glVertexAttribDivisor(ATTRIB_TEXCOORDS, 1);
+	glVertexAttribDivisor(ATTRIB_AXES, 1);
+#endif
+}
+
+// Every texture bind goes through here, so we know what each unit holds
+// and flushes only rebind the slots that changed.
+void bind_texture(uint32_t unit, uint32_t id) {
+	if (self.bound[unit] != id) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, id);
+		self.bound[unit] = id;
+		self.stats.texture_binds++;
+	}
+}
+
+void use_shader(uint32_t shader) {
+	if (self.program != shader) {
+		glUseProgram(shader);
+		self.program = shader;
+		self.stats.shader_binds++;
+	}
+}
+
+// Takes a texture slot for the quads that follow, only a batch that
+// already samples from every slot needs to be flushed.
+void use_texture(uint32_t id) {
+	for (uint32_t s = 0; s < self.slot_count; s++) {
+		if (self.slots[s] == id) {
+			self.hot_slot = s;
+			return;
+		}
+	}
+
+	if (self.slot_count == self.max_slots) {
+		flush_batch(FLUSH_TEXTURE);
+		self.slot_count = 0;
+	}
+	self.slots[self.slot_count] = id;
+	self.hot_slot = self.slot_count++;
+}
+
+// Binds the textures of a batch to their units and tells the fragment
+// shader which of them, if any, holds distance fields.
+void bind_slots(const uint32_t *slots, uint32_t count) {
+	int32_t sdf_slot = -1;
+	for (uint32_t i = 0; i < count; i++) {
+		bind_texture(i, slots[i]);
+		if (self.glyph_texture && slots[i] == self.glyph_texture) {
+			sdf_slot = (int32_t)i;
+		}
+	}
+	if (self.sdf_slot != sdf_slot) {
+		glUniform1i(self.sdf_slot_loc, sdf_slot);
+		self.sdf_slot = sdf_slot;
+	}
+}
+
+void apply_blend(BlendMode b) {
+	if (self.blend == b) {
+		return;
+	}
+	flush_batch(FLUSH_STATE);
+	self.blend = b;
+	blend_func(b);
+}
+
+void blend_func(BlendMode b) {
+	switch (b) {
+		case BLEND_ALPHA:         glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA); break;
+		case BLEND_ADDITIVE:      glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE); break;
+		case BLEND_MULTIPLY:      glBlendFuncSeparate(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE); break;
+		case BLEND_PREMULTIPLIED: glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); break;
+	}
+}
+
+// Drops every reference we keep to a texture that is about to be deleted
+void forget_texture(uint32_t id) {
+	// Recorded quads may still sample from it
+	if (self.command_count || self.deferring) {
+		flush_now(FLUSH_TEXTURE);
+	}
+	self.frame_dirty = true;
+	for (uint32_t s = 0; s < self.slot_count; s++) {
+		if (self.slots[s] == id) {
+			flush_batch(FLUSH_TEXTURE);
+			self.slot_count = 0;
+			renderer_set_image(self.hot_image.id == id ? self.pixel : self.hot_image);
+			break;
+		}
+	}
+	for (uint32_t u = 0; u < MAX_TEXTURE_SLOTS; u++) {
+		if (self.bound[u] == id) {
+			self.bound[u] = 0;
+		}
+	}
+}
+
+// Uploads a glyph cell, flushing first if quads still pending sample the
+// glyph it replaces
+void store_glyph(int32_t x, int32_t y, const uint8_t *texels, const Glyph *old) {
+	if (old) {
+		if (old->last_used > self.glyphs.flushed) {
+			flush_now(FLUSH_TEXTURE);
+		}
+		self.stats.glyph_evictions++;
+	}
+	if (texels) {
+		bind_texture(0, self.glyph_texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, GLYPH_CELL, GLYPH_CELL, GL_RED, GL_UNSIGNED_BYTE, texels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		self.stats.texture_bytes += GLYPH_CELL * GLYPH_CELL;
+	}
+	self.stats.glyphs_rasterized++;
+	self.frame_dirty = true;
+}
+
+// 64 bit FNV-1a over the string and then the style
+uint64_t text_hash(uint32_t font, const char *text, size_t length, float size, float width) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)text[i]) * 0x100000001B3ull;
+	}
+	uint32_t style[3] = { font };
+	memcpy(&style[1], &size, sizeof(float));
+	memcpy(&style[2], &width, sizeof(float));
+	for (uint32_t i = 0; i < 3; i++) {
+		hash = (hash ^ style[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+// Whether a cached layout was built from this very string and style
+bool layout_matches(const TextLayout *l, uint32_t font, const char *text, size_t length, float size, float width) {
+	return l->font == font && l->size == size && l->width == width
+		&& l->length == length && memcmp(l->text, text, length) == 0;
+}
+
+// Drops the least recently drawn layout and gives its blocks back
+void layout_evict() {
+	int16_t oldest = -1;
+	for (int16_t i = 0; i < TEXT_LAYOUTS; i++) {
+		uint32_t used = self.layouts[i].last_used;
+		if (used && (oldest < 0 || used < self.layouts[oldest].last_used)) {
+			oldest = i;
+		}
+	}
+	TextLayout *l = &self.layouts[oldest];
+	int16_t *link = &self.layout_buckets[l->hash % TEXT_BUCKETS];
+	while (*link != oldest) {
+		link = &self.layouts[*link].next;
+	}
+	*link = l->next;
+
+	if (l->first_block >= 0) {
+		int16_t last = l->first_block;
+		self.free_blocks++;
+		while (self.block_next[last] >= 0) {
+			last = self.block_next[last];
+			self.free_blocks++;
+		}
+		self.block_next[last] = self.free_block;
+		self.free_block = l->first_block;
+	}
+	free(l->text);
+	l->text = NULL;
+	l->last_used = 0;
+	l->next = self.free_layout;
+	self.free_layout = oldest;
+}
+
+void draw_glyphs(uint32_t font, LaidGlyph *glyphs, uint32_t count, float x, float y) {
+	for (uint32_t i = 0; i < count; i++) {
+		LaidGlyph *lg = &glyphs[i];
+		Glyph *g = glyph_resolve(&self.glyphs, font, lg);
+		Shape s = {
+			x + lg->x, y + lg->y, lg->w, 0.f, 0.f, lg->h,
+			g->u0, g->v0, g->u1, g->v1, self.hot_color };
+		submit(&s);
+	}
+}
+
+static uint32_t atlas_page_texture() {
+	uint32_t id;
+	glGenTextures(1, &id);
+	bind_texture(0, id);
+	texture_storage(GL_RGBA8, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return id;
+}
+
+Image atlas_region_image(uint32_t region) {
+	AtlasRegion *r = &self.regions[region - 1];
+	float x = (float)(r->x + ATLAS_PADDING);
+	float y = (float)(r->y + ATLAS_PADDING);
+
+	return (Image) {
+		.id = self.pages[r->page].id, .width = r->w, .height = r->h,
+		.u0 = x / ATLAS_PAGE_SIZE, .v0 = y / ATLAS_PAGE_SIZE,
+		.u1 = (x + r->w) / ATLAS_PAGE_SIZE, .v1 = (y + r->h) / ATLAS_PAGE_SIZE,
+		.region = region };
+}
+
+// Padded size of a region, index ATLAS_MAX_REGIONS stands for the image
+// that didn't fit while repacking
+static int32_t pending_size[2];
+
+static int32_t region_size(uint32_t i, int32_t axis) {
+	if (i == ATLAS_MAX_REGIONS) {
+		return pending_size[axis];
+	}
+	return (axis ? self.regions[i].h : self.regions[i].w) + 2 * ATLAS_PADDING;
+}
+
+static int compare_height(const void *a, const void *b) {
+	return region_size(*(const uint32_t*)b, 1) - region_size(*(const uint32_t*)a, 1);
+}
+
+static void atlas_copy(uint32_t src, int32_t sx, int32_t sy, uint32_t dst, int32_t dx, int32_t dy, int32_t w, int32_t h) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, self.fbos[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, src, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, self.fbos[1]);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0);
+	glBlitFramebuffer(sx, sy, sx + w, sy + h, dx, dy, dx + w, dy + h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+// The skyline never reuses space below its top, so pages get fragmented as
+// images are freed. This packs every live region again from scratch, tallest
+// first, into new pages with room for one more w x h rect.
+static bool atlas_repack(int32_t w, int32_t h, uint32_t *page, int32_t *x, int32_t *y) {
+	static Skyline  plan[ATLAS_MAX_PAGES];
+	static uint32_t order[ATLAS_MAX_REGIONS + 1];
+	static int32_t  placed[ATLAS_MAX_REGIONS + 1][3];
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < ATLAS_MAX_REGIONS; i++) {
+		if (self.regions[i].live) {
+			order[count++] = i;
+		}
+	}
+	order[count++] = ATLAS_MAX_REGIONS;
+	pending_size[0] = w;
+	pending_size[1] = h;
+	qsort(order, count, sizeof(order[0]), compare_height);
+
+	// Plan everything first so a failure leaves the atlas untouched
+	uint32_t used = 0;
+	for (uint32_t n = 0; n < count; n++) {
+		int32_t rw = region_size(order[n], 0);
+		int32_t rh = region_size(order[n], 1);
+		uint32_t p = 0;
+		while (p < used && !skyline_pack(&plan[p], rw, rh, &placed[n][1], &placed[n][2])) {
+			p++;
+		}
+		if (p == used) {
+			if (used == ATLAS_MAX_PAGES) {
+				return false;
+			}
+			skyline_init(&plan[used++], ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+			if (!skyline_pack(&plan[p], rw, rh, &placed[n][1], &placed[n][2])) {
+				return false;
+			}
+		}
+		placed[n][0] = p;
+	}
+
+	// Move the texels over to the new pages
+	flush_now(FLUSH_TEXTURE);
+	if (!self.fbos[0]) {
+		glGenFramebuffers(2, self.fbos);
+	}
+	uint32_t ids[ATLAS_MAX_PAGES];
+	for (uint32_t p = 0; p < used; p++) {
+		ids[p] = atlas_page_texture();
+	}
+	for (uint32_t n = 0; n < count; n++) {
+		if (order[n] == ATLAS_MAX_REGIONS) {
+			*page = placed[n][0];
+			*x = placed[n][1];
+			*y = placed[n][2];
+			continue;
+		}
+		AtlasRegion *r = &self.regions[order[n]];
+		atlas_copy(self.pages[r->page].id, r->x, r->y, ids[placed[n][0]], placed[n][1], placed[n][2],
+			region_size(order[n], 0), region_size(order[n], 1));
+		r->page = placed[n][0];
+		r->x = placed[n][1];
+		r->y = placed[n][2];
+	}
+	restore_framebuffer();
+
+	for (uint32_t p = 0; p < ATLAS_MAX_PAGES; p++) {
+		if (self.pages[p].id) {
+			forget_texture(self.pages[p].id);
+			glDeleteTextures(1, &self.pages[p].id);
+		}
+		self.pages[p] = (AtlasPage){ .id = p < used ? ids[p] : 0 };
+		self.pages[p].packer = plan[p];
+	}
+	for (uint32_t i = 0; i < ATLAS_MAX_REGIONS; i++) {
+		AtlasRegion *r = &self.regions[i];
+		if (r->live) {
+			self.pages[r->page].live++;
+			self.pages[r->page].area += r->w * r->h;
+		}
+	}
+
+	// Anything the caller set before still points to the old pages, and
+	// the last frame may compare equal while its texels moved
+	renderer_set_image(self.hot_image);
+	renderer_invalidate_frame();
+	return true;
+}
+
+Image atlas_add(int32_t width, int32_t height, const uint8_t *pixels) {
+	int32_t w = width + 2 * ATLAS_PADDING;
+	int32_t h = height + 2 * ATLAS_PADDING;
+
+	uint32_t region = 0;
+	for (uint32_t i = 0; i < ATLAS_MAX_REGIONS && !region; i++) {
+		if (!self.regions[i].live) {
+			region = i + 1;
+		}
+	}
+	if (!region) {
+		return (Image){ 0 };
+	}
+
+	// First page with room, then a new page, then repack everything
+	int32_t x = 0, y = 0;
+	uint32_t page = 0;
+	while (page < ATLAS_MAX_PAGES && !(self.pages[page].id && skyline_pack(&self.pages[page].packer, w, h, &x, &y))) {
+		page++;
+	}
+	if (page == ATLAS_MAX_PAGES) {
+		for (page = 0; page < ATLAS_MAX_PAGES && self.pages[page].id; page++);
+		if (page < ATLAS_MAX_PAGES) {
+			self.pages[page] = (AtlasPage){ .id = atlas_page_texture() };
+			skyline_init(&self.pages[page].packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+			skyline_pack(&self.pages[page].packer, w, h, &x, &y);
+		}
+		else if (!atlas_repack(w, h, &page, &x, &y)) {
+			return (Image){ 0 };
+		}
+	}
+
+	// Extrude the border into the padding
+	uint8_t *cell = malloc(w * h * 4);
+	for (int32_t cy = 0; cy < h; cy++) {
+		int32_t sy = cy - ATLAS_PADDING;
+		sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+		for (int32_t cx = 0; cx < w; cx++) {
+			int32_t sx = cx - ATLAS_PADDING;
+			sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+			memcpy(cell + (cy * w + cx) * 4, pixels + (sy * width + sx) * 4, 4);
+		}
+	}
+	bind_texture(0, self.pages[page].id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, cell);
+	free(cell);
+	self.stats.texture_bytes += w * h * 4;
+	self.frame_dirty = true;
+
+	self.regions[region - 1] = (AtlasRegion){
+		.live = true, .page = page, .x = x, .y = y, .w = width, .h = height };
+	self.pages[page].live++;
+	self.pages[page].area += width * height;
+
+	return atlas_region_image(region);
+}
+
+void atlas_free(uint32_t region) {
+	AtlasRegion *r = &self.regions[region - 1];
+	if (!r->live) {
+		return;
+	}
+	r->live = false;
+	renderer_invalidate_frame();
+
+	// Evict pages nobody uses anymore
+	AtlasPage *page = &self.pages[r->page];
+	page->live--;
+	page->area -= r->w * r->h;
+	if (page->live == 0) {
+		forget_texture(page->id);
+		glDeleteTextures(1, &page->id);
+		page->id = 0;
+	}
+}
+
+// Whether the context is at least version `major`.`minor` or has `extension`
+bool gl_supports(GLint major, GLint minor, const char *extension) {
+	GLint gl_major = 0, gl_minor = 0, count = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+	glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+	if (major && (gl_major > major || (gl_major == major && gl_minor >= minor))) {
+		return true;
+	}
+
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extension)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void stream_init() {
+	bool has_storage = gl_supports(4, 4, "GL_ARB_buffer_storage");
+
+	GLsizeiptr size = STREAM_REGIONS * MAX_QUADS * sizeof(Quad);
+	glGenBuffers(1, &self.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, self.vbo);
+
+	if (has_storage && glBufferStorage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		self.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	}
+
+	self.region = 0;
+	self.quads = self.mapped ? self.mapped : self.staging;
+}
+
+// Fence the region we were writing and move to the next one, waiting
+// for the GPU only when it is still reading from it.
+void stream_next_region() {
+	if (self.curr_quad == 0) {
+		return;
+	}
+	if (self.recording || self.deferring) {
+		// Everything in `staging` was already moved out by flush_batch
+		self.curr_quad = 0;
+		self.first_quad = 0;
+		return;
+	}
+	self.fences[self.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	self.region = (self.region + 1) % STREAM_REGIONS;
+
+	GLsync fence = self.fences[self.region];
+	if (fence) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			self.stats.fence_waits++;
+			do {
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		self.fences[self.region] = NULL;
+	}
+
+	self.quads = self.mapped ? self.mapped + self.region * MAX_QUADS : self.staging;
+	self.curr_quad = 0;
+	self.first_quad = 0;
+}
+
+#ifndef NEKO_INSTANCED
+// sugar dummy bunny way to create a vertex (because is pretty anoying write it manually)
+Vertex make_v(float x, float y, float u, float v, QuadColor color) {
+#ifdef NEKO_PACKED_VERTEX
+	return (Vertex) { x, y, color, unorm_uv(u, self.hot_slot & 3), unorm_uv(v, self.hot_slot >> 2) };
+#else
+	return (Vertex) {
+		x, y, color.r, color.g,
+		color.b, color.a, u, v, self.hot_slot };
+#endif
+}
+#endif
+
+#if defined(NEKO_INSTANCED) || defined(NEKO_PACKED_VERTEX)
+// Coordinates outside 0..1 would spill into the slot bits, so they are
+// clamped (NaN ends up as 0)
+uint16_t unorm_uv(float f, uint32_t slot_bits) {
+	f = f > 0.f ? (f < 1.f ? f : 1.f) : 0.f;
+	return (uint16_t)((uint32_t)(f * UV_MAX + .5f) << UV_SLOT_BITS | slot_bits);
+}
+
+// The slot bits stored below a u, v pair, starting at bit `first` of the slot
+uint32_t slot_pair(uint32_t slot, uint32_t first) {
+	uint32_t mask = (1u << UV_SLOT_BITS) - 1;
+	return (slot >> first & mask) | (slot >> (first + UV_SLOT_BITS) & mask) << 16;
+}
+#endif
+
+uint32_t compile_shader(const char *src, uint32_t kind) {
+	uint32_t shader = glCreateShader(kind);
+	glShaderSource(shader, 1, &src, NULL);
+	glCompileShader(shader);
+
+	// Getting the result of compiling process
+	int32_t success;
+	char infoLog[512];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if(!success) {
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		glDeleteShader(shader);
+		printf("[ERROR] %s\n", infoLog);
+		return 0;
+	}
+
+	return shader;
+}
+
+uint32_t compile_shader_src(const char *vs, const char *fs) {
+	uint32_t vertexShader = compile_shader(vs, GL_VERTEX_SHADER);
+	uint32_t fragmentShader = compile_shader(fs, GL_FRAGMENT_SHADER);
+
+	uint32_t program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (self.binary_format_count) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	// Get compile result status
+	int32_t success;
+	char infoLog[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if(!success) {
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		glDeleteProgram(program);
+		printf("[ERROR] %s\n", infoLog);
+		return 0;
+	}
+
+	return program;
+}
+
+// Links a program, from the shader cache when it has one the driver takes
+uint32_t load_program(const char *vs, const char *fs) {
+	uint64_t key = program_key(vs, fs);
+	uint32_t program = cached_program(key);
+	if (program) {
+		self.startup.programs_cached++;
+		return program;
+	}
+	program = compile_shader_src(vs, fs);
+	if (program) {
+		self.startup.programs_compiled++;
+		cache_program(key, program);
+	}
+	return program;
+}
+
+// 64 bit FNV-1a over the sources and the driver strings, terminators
+// included so they can't run into each other
+uint64_t program_key(const char *vs, const char *fs) {
+	const char *strings[] = {
+		vs, fs,
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION) };
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint32_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		const char *p = strings[i] ? strings[i] : "";
+		do {
+			hash = (hash ^ (uint8_t)*p) * 0x100000001B3ull;
+		} while (*p++);
+	}
+	return hash;
+}
+
+// Returns 0 when there is no binary for `key` or the driver rejects it,
+// the program gets built from source then
+uint32_t cached_program(uint64_t key) {
+	if (!self.shader_cache[0] || !self.binary_format_count) {
+		return 0;
+	}
+	size_t size = 0;
+	uint8_t *file = system_load_file(self.shader_cache, &size);
+	if (!file) {
+		return 0;
+	}
+
+	uint32_t program = 0;
+	for (size_t offset = 0; offset + sizeof(CachedProgram) <= size; ) {
+		CachedProgram record;
+		memcpy(&record, file + offset, sizeof(record));
+		offset += sizeof(record);
+		if (record.size > size - offset) {
+			break;
+		}
+		bool known = false;
+		for (GLint f = 0; f < self.binary_format_count; f++) {
+			known |= (GLenum)self.binary_formats[f] == record.format;
+		}
+		if (record.key == key && known) {
+			GLint linked = 0;
+			program = glCreateProgram();
+			glProgramBinary(program, record.format, file + offset, record.size);
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+			if (!linked) {
+				glDeleteProgram(program);
+				program = 0;
+			}
+			break;
+		}
+		offset += record.size;
+	}
+	free(file);
+	return program;
+}
+
+// Adds the binary of `program` to the shader cache, replacing whatever
+// was there for `key`. The new cache is written next to the old one and
+// then moved over it, so a crash or another instance never sees half of
+// it. Failing to write only costs the next launch time.
+void cache_program(uint64_t key, uint32_t program) {
+	GLint length = 0;
+	if (!self.shader_cache[0] || !self.binary_format_count) {
+		return;
+	}
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	CachedProgram record = { .key = key };
+	uint8_t *binary = malloc(length);
+	glGetProgramBinary(program, length, NULL, &record.format, binary);
+	record.size = length;
+
+	char tmp[sizeof(self.shader_cache) + 4];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", self.shader_cache);
+	size_t size = 0;
+	uint8_t *old = system_load_file(self.shader_cache, &size);
+	FILE *file = fopen(tmp, "wb");
+	if (file) {
+		for (size_t offset = 0; old && offset + sizeof(CachedProgram) <= size; ) {
+			CachedProgram r;
+			memcpy(&r, old + offset, sizeof(r));
+			if (r.size > size - offset - sizeof(r)) {
+				break;
+			}
+			if (r.key != key) {
+				fwrite(old + offset, 1, sizeof(r) + r.size, file);
+			}
+			offset += sizeof(r) + r.size;
+		}
+		bool written = fwrite(&record, sizeof(record), 1, file) == 1
+			&& fwrite(binary, 1, record.size, file) == record.size;
+		written &= fclose(file) == 0;
+		if (!written || !system_replace_file(tmp, self.shader_cache)) {
+			remove(tmp);
+		}
+	}
+	free(old);
+	free(binary);
+}
+
+void load_worker(void *arg) {
+	(void)arg;
+	TRACE_THREAD("image loader");
+	for (;;) {
+		system_wait(self.load_signal);
+		system_lock(self.load_mutex);
+		uint32_t l = self.load_jobs[self.jobs_head++ % MAX_LOADS];
+		system_unlock(self.load_mutex);
+
+		// NOTE: stb_image keeps its failure reason in a global, threads
+		// may race on that but not on the decoding itself
+		TRACE_BEGIN("decode image");
+		int32_t w, h, n;
+		uint8_t *pixels = stbi_load(self.loads[l].filename, &w, &h, &n, 4);
+		TRACE_END();
+
+		system_lock(self.load_mutex);
+		self.loads[l].pixels = pixels;
+		self.load_done[self.done_tail++ % MAX_LOADS] = l;
+		system_unlock(self.load_mutex);
+	}
+}
+
+// Takes the loads workers are done with and uploads them in order,
+// until `budget` bytes went through
+void upload_loads(uint32_t budget) {
+	if (!self.loads_pending) {
+		return;
+	}
+	TRACE_BEGIN("upload images");
+	if (self.load_mutex) {
+		system_lock(self.load_mutex);
+		while (self.done_head != self.done_tail) {
+			uint32_t l = self.load_done[self.done_head++ % MAX_LOADS];
+			self.loads[l].state = LOAD_DECODED;
+			self.uploads[self.uploads_tail++ % MAX_LOADS] = l;
+		}
+		system_unlock(self.load_mutex);
+	}
+
+	while (self.uploads_head != self.uploads_tail) {
+		ImageLoad *load = &self.loads[self.uploads[self.uploads_head % MAX_LOADS]];
+		// The worker couldn't decode it, the placeholder stays
+		if (!load->cancelled && !load->pixels) {
+			load->state = LOAD_FAILED;
+			self.loads_pending--;
+			self.uploads_head++;
+			continue;
+		}
+		if (!load->cancelled && !upload_rows(load, &budget)) {
+			break;
+		}
+		self.uploads_head++;
+		if (load->cancelled) {
+			if (load->texture) {
+				glDeleteTextures(1, &load->texture);
+			}
+			if (!load->mapped) {
+				stbi_image_free(load->pixels);
+			}
+			free(load->filename);
+			*load = (ImageLoad){ 0 };
+			self.loads_pending--;
+		}
+	}
+	TRACE_END();
+}
+
+// Uploads as many rows of `load` as `budget` allows, at least one, and
+// returns whether it got to the last one
+bool upload_rows(ImageLoad *load, uint32_t *budget) {
+	if (*budget == 0) {
+		return false;
+	}
+
+	int32_t w = load->image.width;
+	int32_t h = load->image.height;
+	uint32_t pitch = w * 4;
+	if (load->rows == 0 && w <= ATLAS_MAX_IMAGE && h <= ATLAS_MAX_IMAGE) {
+		Image img = atlas_add(w, h, load->pixels);
+		if (img.id) {
+			*budget -= h * pitch < *budget ? h * pitch : *budget;
+			self.stats.upload_bytes += h * pitch;
+			finish_load(load, img);
+			return true;
+		}
+	}
+
+	if (!load->texture) {
+		glGenTextures(1, &load->texture);
+		bind_texture(0, load->texture);
+		texture_storage(GL_RGBA8, w, h, 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	if (!self.upload_pbo) {
+		glGenBuffers(1, &self.upload_pbo);
+	}
+
+	int32_t rows = h - load->rows;
+	if ((uint32_t)rows > *budget / pitch) {
+		rows = *budget / pitch > 0 ? *budget / pitch : 1;
+	}
+	uint32_t size = rows * pitch;
+	*budget -= size < *budget ? size : *budget;
+
+	// Invalidating the buffer on map lets the driver hand out fresh storage
+	// instead of waiting for the last transfer, and the rows are copied
+	// straight into it
+	bind_texture(0, load->texture);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, self.upload_pbo);
+	if (size > self.upload_pbo_size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		self.upload_pbo_size = size;
+	}
+	void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	memcpy(dst, load->pixels + (size_t)load->rows * pitch, size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load->rows, w, rows, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	self.stats.upload_bytes += size;
+	self.stats.texture_bytes += size;
+
+	load->rows += rows;
+	// NOTE: no mipmaps, with a GL_LINEAR min filter they're never sampled
+	// and generating them is the kind of stall this path avoids
+	if (load->rows < h) {
+		return false;
+	}
+	finish_load(load, (Image){
+		.id = load->texture, .width = w, .height = h,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f });
+	return true;
+}
+
+void finish_load(ImageLoad *load, Image image) {
+	if (!load->mapped) {
+		stbi_image_free(load->pixels);
+	}
+	load->pixels = NULL;
+	load->texture = 0;
+	load->image = image;
+	load->state = LOAD_READY;
+	self.loads_pending--;
+	self.frame_dirty = true;
 }
@@ -6,6 +6,8 @@
 #define NEKO_renderer_H
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include "math.h"
 #include "stb/stb_truetype.h"
 
@@ -14,20 +16,237 @@
 
 typedef struct { float r, g, b, a; } Color;
 
+typedef enum
+{
+	BLEND_ALPHA,
+	BLEND_ADDITIVE,
+	BLEND_MULTIPLY,
+	// For images whose color is already multiplied by their alpha, like
+	// render targets that were drawn into with translucent quads
+	BLEND_PREMULTIPLIED,
+}
+BlendMode;
+
 typedef struct
 {
 	uint32_t id;
 	int32_t  width;
 	int32_t  height;
+	// Where the image sits inside texture `id`. Images loaded from disk
+	// share atlas pages, for them `region` is non zero and the renderer
+	// looks it up again in case the atlas got repacked.
+	float    u0, v0, u1, v1;
+	uint32_t region;
+	// Images from renderer_load_image_async look up what they stand for
+	// every time they are used, like atlas images do
+	uint32_t load;
 }
 Image;
 
+typedef enum
+{
+	TEXTURE_RGBA8,
+	// Decoded to linear when sampled, only looks right drawn into a
+	// framebuffer that encodes back to sRGB
+	TEXTURE_SRGB8_ALPHA8,
+	// One byte per pixel masks, drawn as white with that alpha and tinted
+	// by the current color
+	TEXTURE_R8,
+	// Two bytes per pixel, gray and alpha
+	TEXTURE_RG8,
+}
+TextureFormat;
+
+typedef enum { FILTER_LINEAR, FILTER_NEAREST } TextureFilter;
+// Builds with NEKO_PACKED_VERTEX or NEKO_INSTANCED clamp the texture
+// coordinates of every corner to 0..1, so WRAP_REPEAT and WRAP_MIRROR can't
+// tile an image there, a quad reaching past 1 gets the image stretched.
+typedef enum { WRAP_REPEAT, WRAP_CLAMP, WRAP_MIRROR } TextureWrap;
+
+typedef enum
+{
+	MIPS_NONE,
+	// Mip levels cost a third more memory and upload time, they are only
+	// worth it for images drawn a lot smaller than they are
+	MIPS_GENERATE,
+}
+MipPolicy;
+
+// How renderer_create_image stores and samples a texture, a zeroed
+// descriptor gives what renderer_mem_image does
+typedef struct
+{
+	TextureFormat format;
+	TextureFilter filter;
+	TextureWrap   wrap;
+	MipPolicy     mips;
+}
+TextureDesc;
+
+typedef struct { uint32_t id; } Typeface;
+typedef struct { uint32_t id; } StaticBatch;
+
+// One quad for renderer_push_quads, drawn with the current image,
+// transform and blend mode like renderer_push_quad would.
+typedef struct
+{
+	float x, y, w, h;
+	float u0, v0, u1, v1;
+	Color color;
+}
+Sprite;
+
+// How renderer_end_frame saves work on frames that didn't change
+typedef enum
+{
+	DAMAGE_OFF,
+	// Frames exactly like the last one aren't drawn at all
+	DAMAGE_SKIP,
+	// And frames where only some quads changed redraw just the rect
+	// around them, at the cost of drawing the frame offscreen first
+	DAMAGE_PARTIAL,
+}
+DamageMode;
+
+// Instruction sets renderer_push_quads can generate vertices with
+typedef enum
+{
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX2,
+}
+SimdLevel;
+
+// Why a batch of quads was cut short, see RendererStats.flushes
+typedef enum
+{
+	// renderer_flush called by the user
+	FLUSH_EXPLICIT,
+	// renderer_end_frame
+	FLUSH_FRAME,
+	// No texture slot left for renderer_set_image, or a texture the batch
+	// samples from is about to change
+	FLUSH_TEXTURE,
+	// The vertex ring region or the sorted commands ran out of room
+	FLUSH_OVERFLOW,
+	// Blend mode, targets, static batches, sorting or damage mode changes
+	FLUSH_STATE,
+	FLUSH_REASONS,
+}
+FlushReason;
+
+typedef struct
+{
+	// Draw calls issued to GL and the vertices they went through
+	uint32_t draw_calls;
+	uint32_t vertices;
+	// Quads that made it into a batch and quads dropped for being out of view
+	uint32_t quads_drawn;
+	uint32_t quads_culled;
+	// Times the CPU had to block on a vertex ring region the GPU was still reading
+	uint32_t fence_waits;
+	// Batches ended with quads in them, by what ended them
+	uint32_t flushes[FLUSH_REASONS];
+	// Bytes handed to GL for vertex buffers and for textures, images
+	// loaded asynchronously included
+	uint32_t vertex_bytes;
+	uint32_t texture_bytes;
+	// Textures and shaders actually bound, binding what already is skipped
+	uint32_t texture_binds;
+	uint32_t shader_binds;
+	// Glyphs rasterized into the glyph atlas and glyphs evicted to make room
+	uint32_t glyphs_rasterized;
+	uint32_t glyph_evictions;
+	// Texts drawn from the layout cache and texts that had to be laid out
+	uint32_t text_hits;
+	uint32_t text_misses;
+	// Render targets drawn into and cached ones that were still good
+	uint32_t targets_drawn;
+	uint32_t targets_cached;
+	// Frames left as they were and frames only partly redrawn since
+	// renderer_init, these two aren't reset every frame
+	uint32_t frames_skipped;
+	uint32_t frames_partial;
+	// Bytes of asynchronously loaded images uploaded this frame
+	uint32_t upload_bytes;
+	// Atlas pages alive and how much of their area images cover
+	uint32_t atlas_pages;
+	float    atlas_fill;
+}
+RendererStats;
+
+// Durations in milliseconds: the latest one and percentiles over the last
+// few hundred, `samples` is how many those are (0 when never measured)
+typedef struct
+{
+	float    last;
+	float    p50;
+	float    p95;
+	float    p99;
+	uint32_t samples;
+}
+Timing;
+
+typedef struct
+{
+	// From renderer_frame to renderer_end_frame, or to the next
+	// renderer_frame for frames that aren't ended. GPU times lag a few
+	// frames behind, they are read once the GPU is surely done.
+	Timing frame_cpu;
+	Timing frame_gpu;
+	// Every flush that draws something, the GPU only times the first few
+	// of each frame
+	Timing flush_cpu;
+	Timing flush_gpu;
+	Timing swap_cpu;
+}
+FrameStats;
+
+typedef struct
+{
+	// All of renderer_init and the part of it getting shaders ready
+	float    init_ms;
+	float    shaders_ms;
+	// Programs loaded from the shader cache and programs built from source
+	uint32_t programs_cached;
+	uint32_t programs_compiled;
+}
+StartupStats;
+
 void renderer_init();
 void renderer_frame();
 void renderer_flush();
+// Ends the frame, returns false when there is nothing new to show so
+// swapping buffers can be skipped
+bool renderer_end_frame();
+RendererStats renderer_get_stats();
+FrameStats renderer_get_frame_stats();
+StartupStats renderer_get_startup_stats();
+// system_swap_buffers, timed for renderer_get_frame_stats
+void renderer_swap_buffers();
+// Prints the stats of a frame to stderr every `frames` frames, 0 stops it
+void renderer_log_stats(uint32_t frames);
+
+// With damage tracking on everything between renderer_frame and
+// renderer_end_frame is recorded and compared against the last frame,
+// nothing reaches GL until renderer_end_frame decides what to redraw.
+void renderer_set_damage(DamageMode mode);
+// The next frame is drawn whole even if nothing changed. renderer_frame
+// does this itself when system_window_damaged says the window lost what
+// it showed, this is for whatever else changes pixels behind the same quads.
+void renderer_invalidate_frame();
 
 void renderer_set_image(Image i);
 void renderer_set_color(Color c);
+void renderer_set_blend(BlendMode b);
+
+// While sorting is on quads are recorded instead of streamed, and the next
+// flush draws them ordered by layer, then depth, then by state so quads
+// sharing a texture or blend mode end up in the same draw call. Quads on
+// the same layer and depth are free to be reordered.
+void renderer_set_sorting(bool enabled);
+void renderer_set_layer(uint8_t layer);
+void renderer_set_depth(uint16_t depth);
 
 void renderer_push_mat4();
 void renderer_pop_mat4();
@@ -37,7 +256,71 @@ void renderer_rotate(float r);
 
 Image renderer_load_image(const char *filename); 
 Image renderer_mem_image(int32_t width, int32_t height, const uint8_t *pixels);
+// `pixels` are rows of `desc.format` texels, tightly packed, or NULL to
+// leave the image undefined
+Image renderer_create_image(int32_t width, int32_t height, const uint8_t *pixels, TextureDesc desc);
+void  renderer_free_image(Image i);
+
+// Maps a pack built by `make pack`, after that images and fonts found in it
+// by the path they were packed from are loaded from it, decoded already.
+// Returns false when the file is missing or isn't a pack.
+bool  renderer_mount_pack(const char *filename);
+
+// Returns right away with an image of the right size that draws nothing,
+// the file is decoded on a worker thread and uploaded by renderer_frame
+// over the next frames, a bounded amount of bytes each. Loads are tagged
+// with a group so a level can poll or wait on its own images.
+Image    renderer_load_image_async(const char *filename, uint32_t group);
+uint32_t renderer_images_pending(uint32_t group);
+// Loads in `group` whose file couldn't be read or decoded, their images
+// keep drawing nothing until freed
+uint32_t renderer_images_failed(uint32_t group);
+// Blocks until every image in `group` is ready, uploading without a budget
+void     renderer_wait_images(uint32_t group);
+void     renderer_set_upload_budget(uint32_t bytes);
+
+// Images that can be drawn into. Between renderer_begin_target and
+// renderer_end_target everything goes to the target instead of the window,
+// starting from a transparent image and the identity transform. Targets
+// can't be nested, and are freed with renderer_free_image.
+// A cached target keeps what was drawn into it, renderer_begin_target
+// returns false until renderer_invalidate_target marks it dirty and the
+// caller skips drawing it (and calling renderer_end_target) meanwhile.
+Image renderer_create_target(int32_t width, int32_t height, bool cached);
+bool  renderer_begin_target(Image target);
+void  renderer_end_target();
+void  renderer_invalidate_target(Image target);
+
+// Text is drawn from signed distance fields, so any size looks sharp.
+// `size` is the pixel height of a line and (x, y) the top left corner of
+// the first one, the text takes the current color, transform and layer.
+// Layouts are cached by string, font, size and width, so drawing the same
+// text again every frame doesn't lay it out again.
+Typeface renderer_load_font(const char *filename);
+void renderer_draw_text(Typeface font, const char *text, float x, float y, float size);
+// Same, breaking lines after a space where they would get wider than `width`
+void renderer_draw_text_wrapped(Typeface font, const char *text, float x, float y, float size, float width);
 
 void renderer_push_quad(float x1, float y1, float x2, float y2, float u0, float u1, float v0, float v1);
+void renderer_push_quads(const Sprite *sprites, size_t count);
+
+// Quads pushed between these two calls are recorded into a GPU buffer of
+// their own instead of being drawn, culling and sorting are off meanwhile.
+// renderer_draw_static then draws them all under the current transform
+// without sending them again. They keep the textures and coordinates they
+// were recorded with, so freeing those images, or glyphs or atlas images
+// moving around after that, leaves the batch drawing stale texels.
+void renderer_begin_static();
+StaticBatch renderer_end_static();
+void renderer_draw_static(StaticBatch batch);
+void renderer_free_static(StaticBatch batch);
+
+// Picks the best level up to `level` the CPU supports and returns it,
+// renderer_init starts with the best one.
+SimdLevel renderer_set_simd(SimdLevel level);
+
+// Quads are dropped when their transformed bounds miss the view, on by
+// default. Turning it off is only useful to debug culling itself.
+void renderer_set_culling(bool enabled);
 
 #endif
\ No newline at end of file
@@ -4,16 +4,58 @@ out vec4 colour;
 
 in vec4 color;
 in vec2 uv;
+flat in uint slot;
 
-uniform sampler2D tex;
+uniform sampler2D u_textures[16];
+// Slot of the glyph atlas, -1 when the batch draws no text
+uniform int u_sdf_slot;
 
-void main() {
-	// SDF font rendering
-	float alpha = texture(tex, uv).r;
-	vec2 tex_size = vec2(textureSize(tex, 0));
-	vec2 density = fwidth(uv) * tex_size;
+// GLYPH_ATLAS_SIZE in renderer.c, the only texture holding distance fields
+const float glyph_atlas_size = 1024.0;
+
+// GLSL 3.30 only indexes sampler arrays with constants. Neighbouring pixels
+// can take different cases, so the gradients for mip selection come from
+// the caller instead of being taken inside the branch.
+vec4 sample_slot(vec2 p, vec2 dx, vec2 dy) {
+	switch (slot) {
+	case 0u:  return textureGrad(u_textures[0], p, dx, dy);
+	case 1u:  return textureGrad(u_textures[1], p, dx, dy);
+	case 2u:  return textureGrad(u_textures[2], p, dx, dy);
+	case 3u:  return textureGrad(u_textures[3], p, dx, dy);
+	case 4u:  return textureGrad(u_textures[4], p, dx, dy);
+	case 5u:  return textureGrad(u_textures[5], p, dx, dy);
+	case 6u:  return textureGrad(u_textures[6], p, dx, dy);
+	case 7u:  return textureGrad(u_textures[7], p, dx, dy);
+	case 8u:  return textureGrad(u_textures[8], p, dx, dy);
+	case 9u:  return textureGrad(u_textures[9], p, dx, dy);
+	case 10u: return textureGrad(u_textures[10], p, dx, dy);
+	case 11u: return textureGrad(u_textures[11], p, dx, dy);
+	case 12u: return textureGrad(u_textures[12], p, dx, dy);
+	case 13u: return textureGrad(u_textures[13], p, dx, dy);
+	case 14u: return textureGrad(u_textures[14], p, dx, dy);
+	default:  return textureGrad(u_textures[15], p, dx, dy);
+	}
+}
+
+// SDF font rendering, `alpha` is the distance field sample and `density`
+// how many of its texels a pixel covers
+float sdf_alpha(float alpha, vec2 density) {
 	float m = min(density.x, density.y);
 	float inv = 1.0 / m;
-	float a = (alpha - 128.0/255.0 + 24.0/255.0*m*0.5) * 255.0/24.0 * inv;
-	colour = vec4(1.0, 1.0, 1.0, a);
-}
\ No newline at end of file
+	return (alpha - 128.0/255.0 + 24.0/255.0*m*0.5) * 255.0/24.0 * inv;
+}
+
+void main() {
+	// Derivatives have to be taken outside of the branch
+	vec2 dx = dFdx(uv);
+	vec2 dy = dFdy(uv);
+	vec2 density = (abs(dx) + abs(dy)) * glyph_atlas_size;
+	vec4 texel = sample_slot(uv, dx, dy);
+
+	if (int(slot) == u_sdf_slot) {
+		colour = vec4(color.rgb, color.a * clamp(sdf_alpha(texel.r, density), 0.0, 1.0));
+	}
+	else {
+		colour = texel * color;
+	}
+}
@@ -3,9 +3,11 @@
 layout (location = 0) in vec2 a_pos;
 layout (location = 1) in vec4 a_color;
 layout (location = 2) in vec2 a_uv;
+layout (location = 4) in uint a_slot;
 
 out vec4 color;
 out vec2 uv;
+flat out uint slot;
 
 uniform mat4 u_proj_view;
 
@@ -13,4 +15,5 @@ void main() {
 	gl_Position = u_proj_view * vec4(a_pos, 0.0, 1.0);
 	color = a_color;
 	uv = a_uv;
-}
+	slot = a_slot;
+}
\ No newline at end of file
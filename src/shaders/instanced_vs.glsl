@@ -0,0 +1,24 @@
+#version 330 core
+
+layout (location = 0) in vec2 a_pos;
+layout (location = 1) in vec4 a_color;
+layout (location = 2) in uvec4 a_uv;
+layout (location = 3) in vec4 a_axes;
+
+out vec4 color;
+out vec2 uv;
+flat out uint slot;
+
+uniform mat4 u_proj_view;
+
+// UNORM15 coordinates, the bit below each one is a bit of the slot
+void main() {
+	// Triangle strip corners: (0, 0), (1, 0), (0, 1), (1, 1)
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 pos = a_pos + a_axes.xy * corner.x + a_axes.zw * corner.y;
+
+	gl_Position = u_proj_view * vec4(pos, 0.0, 1.0);
+	color = a_color;
+	uv = mix(vec2(a_uv.xy >> 1u), vec2(a_uv.zw >> 1u), corner) / 32767.0;
+	slot = (a_uv.x & 1u) | ((a_uv.y & 1u) << 1u) | ((a_uv.z & 1u) << 2u) | ((a_uv.w & 1u) << 3u);
+}
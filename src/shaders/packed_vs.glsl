@@ -0,0 +1,19 @@
+#version 330 core
+
+layout (location = 0) in vec2 a_pos;
+layout (location = 1) in vec4 a_color;
+layout (location = 2) in uvec2 a_uv;
+
+out vec4 color;
+out vec2 uv;
+flat out uint slot;
+
+uniform mat4 u_proj_view;
+
+// UNORM14 coordinates, the two bits below each one are half of the slot
+void main() {
+	gl_Position = u_proj_view * vec4(a_pos, 0.0, 1.0);
+	color = a_color;
+	uv = vec2(a_uv >> 2u) / 16383.0;
+	slot = (a_uv.x & 3u) | ((a_uv.y & 3u) << 2u);
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <string.h>
+
+#include "skyline.h"
+
+void skyline_init(Skyline *s, int32_t width, int32_t height) {
+	s->width = width;
+	s->height = height;
+	s->count = 1;
+	s->nodes[0].x = 0;
+	s->nodes[0].y = 0;
+	s->nodes[0].w = width;
+}
+
+// Height a w x h rect would rest at when its left edge is on node `i`,
+// or -1 when it goes past the right or top border.
+static int32_t fit(Skyline *s, int32_t i, int32_t w, int32_t h) {
+	if (s->nodes[i].x + w > s->width) {
+		return -1;
+	}
+
+	int32_t y = 0;
+	for (int32_t left = w; left > 0; i++) {
+		if (s->nodes[i].y > y) {
+			y = s->nodes[i].y;
+		}
+		if (y + h > s->height) {
+			return -1;
+		}
+		left -= s->nodes[i].w;
+	}
+	return y;
+}
+
+static void remove_node(Skyline *s, int32_t i) {
+	memmove(&s->nodes[i], &s->nodes[i + 1], (s->count - i - 1) * sizeof(s->nodes[0]));
+	s->count--;
+}
+
+bool skyline_pack(Skyline *s, int32_t w, int32_t h, int32_t *x, int32_t *y) {
+	if (s->count == SKYLINE_MAX_NODES) {
+		return false;
+	}
+
+	// Lowest top edge wins, ties go to the narrowest segment
+	int32_t best = -1, best_y = 0, best_w = 0;
+	for (int32_t i = 0; i < s->count; i++) {
+		int32_t top = fit(s, i, w, h);
+		if (top < 0) {
+			continue;
+		}
+		if (best < 0 || top < best_y || (top == best_y && s->nodes[i].w < best_w)) {
+			best = i;
+			best_y = top;
+			best_w = s->nodes[i].w;
+		}
+	}
+	if (best < 0) {
+		return false;
+	}
+
+	*x = s->nodes[best].x;
+	*y = best_y;
+
+	// The rect becomes a new segment, shadowing whatever was below it
+	memmove(&s->nodes[best + 1], &s->nodes[best], (s->count - best) * sizeof(s->nodes[0]));
+	s->nodes[best].y = best_y + h;
+	s->nodes[best].w = w;
+	s->count++;
+
+	for (int32_t i = best + 1; i < s->count; i++) {
+		int32_t end = s->nodes[i - 1].x + s->nodes[i - 1].w;
+		if (s->nodes[i].x >= end) {
+			break;
+		}
+		int32_t shrink = end - s->nodes[i].x;
+		s->nodes[i].x += shrink;
+		s->nodes[i].w -= shrink;
+		if (s->nodes[i].w > 0) {
+			break;
+		}
+		remove_node(s, i--);
+	}
+
+	// Merge neighbours at the same height so the list stays short
+	for (int32_t i = 0; i + 1 < s->count; i++) {
+		if (s->nodes[i].y == s->nodes[i + 1].y) {
+			s->nodes[i].w += s->nodes[i + 1].w;
+			remove_node(s, (i--) + 1);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,27 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_SKYLINE_H
+#define NEKO_SKYLINE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define SKYLINE_MAX_NODES 1024
+
+// Bottom-left skyline rectangle packer: the free space is the area above a
+// list of horizontal segments sorted by x. No GL in here, it only does math.
+typedef struct
+{
+	int32_t width;
+	int32_t height;
+	int32_t count;
+	struct { int32_t x, y, w; } nodes[SKYLINE_MAX_NODES];
+}
+Skyline;
+
+void skyline_init(Skyline *s, int32_t width, int32_t height);
+bool skyline_pack(Skyline *s, int32_t w, int32_t h, int32_t *x, int32_t *y);
+
+#endif
@@ -0,0 +1,1411 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+// The renderer on the CPU, for machines without a GPU worth the name:
+// `make SOFT=1` builds this instead of renderer.c. Quads go through the
+// same transforms, culling, sorting and damage tracking (draw_common.c) and
+// text through the same glyph atlas (glyphs.c), then every flush bins the
+// quads into tiles that a thread per core fills in parallel. Each
+// span is sampled (bilinear or nearest) into a row of texels and blended
+// four pixels at a time. The frame lives in memory and reaches the window
+// through system_set_framebuffer.
+// There is no GPU to hide latency from, so images load before returning
+// and there is no atlas, no mip levels and no text layout cache.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <math.h>
+
+#include "system.h"
+#include "renderer.h"
+#include "draw_common.h"
+#include "glyphs.h"
+#include "texfile.h"
+#include "pack.h"
+#include "timing.h"
+#include "trace.h"
+
+#define STBI_NO_THREAD_LOCALS
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEKO_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+// Images alive at once, an Image id is the index + 1
+#define MAX_TEXTURES 1024
+
+// Frames are cut in square tiles, each one filled by a single thread from
+// the quads binned into it, in the order they were pushed. There is a
+// thread per core, up to MAX_RASTER_THREADS. Flushes with fewer quads than
+// RASTER_MIN_QUADS aren't worth waking the workers for.
+#define TILE_SIZE          64
+#define MAX_RASTER_THREADS 64
+#define RASTER_MIN_QUADS   64
+
+// The window starts every frame from this, render targets from zero
+#define CLEAR_COLOR 0xFF1A1A1Au
+
+// Quads recorded while sorting are keyed like in renderer.c
+#define MAX_COMMANDS (1 << 16)
+
+#define MAX_STATIC_BATCHES 64
+
+typedef struct
+{
+	// RGBA8, except the glyph atlas which is a single distance channel
+	uint8_t      *pixels;
+	int32_t       width, height;
+	uint32_t      channels;
+	TextureFilter filter;
+	TextureWrap   wrap;
+	// Render targets, cached ones are only drawn again after being invalidated
+	bool          target;
+	bool          cached;
+	bool          dirty;
+	// Stands for an async load that failed, a transparent texel
+	bool          failed;
+	uint32_t      group;
+}
+Texture;
+
+// A transformed quad: the first corner and the edges from it to the second
+// and the fourth ones. No padding, frames are compared with memcmp.
+typedef struct
+{
+	float    x, y;
+	float    ax, ay;
+	float    bx, by;
+	float    u0, v0, u1, v1;
+	uint32_t color;
+	uint16_t texture;
+	uint16_t blend;
+}
+Quad;
+
+typedef struct
+{
+	uint32_t *pixels;
+	int32_t   width, height;
+}
+Canvas;
+
+typedef struct
+{
+	bool     live;
+	Quad    *quads;
+	uint32_t count;
+}
+StaticData;
+
+static void submit(Quad *q);
+static inline bool quad_visible(const Quad *q);
+static Quad *reserve(uint32_t count);
+static void play_commands();
+static bool end_frame();
+static void flush(FlushReason reason);
+static void flush_now(FlushReason reason);
+static void log_stats();
+static bool damaged_rect(int32_t *rect);
+static void quad_bounds(const Quad *q, float *b);
+static uint32_t new_texture(int32_t width, int32_t height, uint32_t channels);
+static Image load_image(const char *filename);
+static Canvas current_canvas();
+static void clear_canvas(Canvas c, const int32_t *rect, uint32_t color);
+static void rasterize(const Quad *quads, uint32_t count, Canvas canvas, const int32_t *clip);
+static void raster_worker(void *arg);
+static void raster_tiles();
+static void draw_quad(const Quad *q, const int32_t *rect);
+static void blend_span(uint32_t *dst, const uint32_t *src, int32_t n, BlendMode mode);
+static void store_glyph(int32_t x, int32_t y, const uint8_t *texels, const Glyph *old);
+
+static struct
+{
+	Texture   textures[MAX_TEXTURES];
+
+	Image     pixel;
+	uint16_t  hot_texture;
+	float     hot_uv[4];
+	uint32_t  hot_color;
+	uint8_t   hot_layer;
+	uint16_t  hot_depth;
+	BlendMode hot_blend;
+
+	TransformStack transform;
+
+	SimdLevel     simd;
+	bool          culling;
+	float         view[4];
+
+	// Quads pushed since the last flush, in the order they are drawn
+	Quad     *quads;
+	uint32_t  quad_count;
+	uint32_t  quad_size;
+
+	bool      sorting;
+	Quad      commands[MAX_COMMANDS];
+	uint64_t  keys[MAX_COMMANDS];
+	uint64_t  sort_tmp[MAX_COMMANDS];
+	uint32_t  command_count;
+
+	// What the window shows, handed to system_set_framebuffer
+	uint32_t *frame;
+	int32_t   frame_width;
+	int32_t   frame_height;
+
+	// Index + 1 of the target being drawn into, and what the window had
+	uint32_t      target;
+	float         window_view[4];
+	mat3x2        window_transform;
+	TransformKind window_transform_kind;
+
+	// Static batches are cut from the end of `quads` when recording stops
+	StaticData    statics[MAX_STATIC_BATCHES];
+	bool          recording;
+	bool          recording_culling;
+	bool          recording_sorting;
+	uint32_t      static_from;
+
+	// With damage tracking the window quads pile up in `quads` until
+	// renderer_end_frame, which compares them with `last_quads`. The frame
+	// stays in memory, so partial redraws need no copy of it.
+	DamageMode    damage;
+	bool          deferring;
+	bool          frame_dirty;
+	bool          frame_started;
+	Quad         *last_quads;
+	uint32_t      last_count;
+	uint32_t      last_size;
+
+	GlyphCache  glyphs;
+	uint32_t    glyph_texture;
+
+	// A flush sets these up and wakes the workers, which take tiles under
+	// `raster_mutex` until none are left. Tile t has its quads in
+	// `bin_quads` from bin_offsets[t - 1] (0 for the first) to bin_offsets[t].
+	uint32_t      raster_threads;
+	void         *raster_mutex;
+	void         *raster_start;
+	void         *raster_done;
+	const Quad   *raster_quads;
+	Canvas        raster_canvas;
+	int32_t       raster_clip[4];
+	int32_t       tiles_x;
+	uint32_t      tile_count;
+	uint32_t      next_tile;
+	uint32_t     *bin_offsets;
+	uint32_t      bin_offsets_size;
+	uint32_t     *bin_quads;
+	uint32_t      bin_quads_size;
+	uint64_t     *bin_ranges;
+	uint32_t      bin_ranges_size;
+
+	// Mapped by renderer_mount_pack, stays mapped for good
+	Pack          pack;
+
+	RendererStats stats;
+	// renderer_log_stats prints every `log_frames` frames
+	uint32_t      log_frames;
+	uint32_t      frame_count;
+
+	// Everything happens on the CPU, there are no GPU times to report
+	// and no shaders to build
+	StartupStats  startup;
+	double        frame_start;
+	TimingSeries  frame_cpu;
+	TimingSeries  flush_cpu;
+	TimingSeries  swap_cpu;
+}
+self = { 0 };
+
+void renderer_init() {
+	double start = system_time();
+	// Create the pixel image
+	self.pixel = renderer_mem_image(1, 1, (uint8_t[]){255, 255, 255, 255});
+	renderer_set_image(self.pixel);
+
+	// Default color as white
+	renderer_set_color(WHITE);
+	transform_reset(&self.transform);
+	renderer_set_simd(SIMD_AVX2);
+	self.culling = true;
+
+	self.raster_mutex = system_create_mutex();
+	self.raster_start = system_create_semaphore();
+	self.raster_done = system_create_semaphore();
+	uint32_t cores = system_cpu_count();
+	self.raster_threads = cores < MAX_RASTER_THREADS ? cores : MAX_RASTER_THREADS;
+	for (uint32_t t = 1; t < self.raster_threads; t++) {
+		system_create_thread(raster_worker, NULL);
+	}
+	self.startup.init_ms = (float)((system_time() - start) * 1000.0);
+}
+
+void renderer_frame() {
+	TRACE_BEGIN("renderer_frame");
+	if (system_window_damaged()) {
+		renderer_invalidate_frame();
+	}
+	double now = system_time();
+	if (self.frame_start) {
+		timing_push(&self.frame_cpu, (float)((now - self.frame_start) * 1000.0));
+	}
+	self.frame_start = now;
+
+	vec2 w_size = system_window_size();
+	int32_t width = (int32_t)w_size.x;
+	int32_t height = (int32_t)w_size.y;
+	if (!self.frame || self.frame_width != width || self.frame_height != height) {
+		free(self.frame);
+		self.frame = calloc((size_t)width * height, sizeof(uint32_t));
+		self.frame_width = width;
+		self.frame_height = height;
+		self.frame_dirty = true;
+		system_set_framebuffer((const uint8_t *)self.frame, width, height);
+	}
+	self.view[0] = 0.f;
+	self.view[1] = 0.f;
+	self.view[2] = (float)width;
+	self.view[3] = (float)height;
+
+	transform_reset(&self.transform);
+
+	if (self.log_frames && self.frame_count && self.frame_count % self.log_frames == 0) {
+		log_stats();
+	}
+	self.frame_count++;
+	self.stats = (RendererStats){
+		.frames_skipped = self.stats.frames_skipped,
+		.frames_partial = self.stats.frames_partial };
+
+	if (self.damage == DAMAGE_OFF) {
+		int32_t rect[4] = { 0, 0, width, height };
+		clear_canvas(current_canvas(), rect, CLEAR_COLOR);
+		TRACE_END();
+		return;
+	}
+
+	// Nothing gets drawn until renderer_end_frame
+	self.deferring = true;
+	self.frame_started = false;
+	self.quad_count = 0;
+	TRACE_END();
+}
+
+bool renderer_end_frame() {
+	TRACE_BEGIN("renderer_end_frame");
+	bool drawn = end_frame();
+	if (self.frame_start) {
+		timing_push(&self.frame_cpu, (float)((system_time() - self.frame_start) * 1000.0));
+		self.frame_start = 0;
+	}
+	TRACE_END();
+	return drawn;
+}
+
+bool end_frame() {
+	flush(FLUSH_FRAME);
+	if (!self.deferring) {
+		return true;
+	}
+	self.deferring = false;
+
+	// Same quads as last time, then only the ones that changed need to be
+	// drawn again
+	int32_t rect[4] = { 0, 0, self.frame_width, self.frame_height };
+	bool partial = false;
+	if (!self.frame_dirty && !self.frame_started && self.quad_count == self.last_count) {
+		if (!memcmp(self.quads, self.last_quads, self.quad_count * sizeof(Quad))) {
+			self.quad_count = 0;
+			self.stats.frames_skipped++;
+			return false;
+		}
+		if (self.damage == DAMAGE_PARTIAL) {
+			partial = damaged_rect(rect);
+		}
+	}
+
+	Canvas frame = { self.frame, self.frame_width, self.frame_height };
+	if (!self.frame_started) {
+		clear_canvas(frame, rect, CLEAR_COLOR);
+	}
+	self.stats.flushes[FLUSH_FRAME] += self.quad_count > 0;
+	rasterize(self.quads, self.quad_count, frame, rect);
+	self.glyphs.flushed = self.glyphs.tick;
+	self.stats.frames_partial += partial;
+	// Only the last part of a frame drawn in parts is left in `quads`,
+	// the next frame can't be compared against that
+	self.frame_dirty = self.frame_started;
+
+	// This frame is what the next one gets compared against
+	Quad *quads = self.last_quads;
+	self.last_quads = self.quads;
+	self.quads = quads;
+	uint32_t size = self.last_size;
+	self.last_size = self.quad_size;
+	self.quad_size = size;
+	self.last_count = self.quad_count;
+	self.quad_count = 0;
+	return true;
+}
+
+void renderer_set_damage(DamageMode mode) {
+	flush(FLUSH_STATE);
+	self.damage = mode;
+	self.frame_dirty = true;
+}
+
+void renderer_invalidate_frame() {
+	self.frame_dirty = true;
+}
+
+// Draws a deferred frame up to here when something is about to change the
+// textures its quads sample from.
+void flush_now(FlushReason reason) {
+	bool deferred = self.deferring && !self.target && !self.recording;
+	flush(reason);
+	if (deferred && self.quad_count) {
+		self.stats.flushes[reason]++;
+		Canvas frame = { self.frame, self.frame_width, self.frame_height };
+		int32_t rect[4] = { 0, 0, self.frame_width, self.frame_height };
+		if (!self.frame_started) {
+			clear_canvas(frame, rect, CLEAR_COLOR);
+		}
+		rasterize(self.quads, self.quad_count, frame, rect);
+		self.glyphs.flushed = self.glyphs.tick;
+		self.frame_started = true;
+		self.frame_dirty = true;
+		self.quad_count = 0;
+	}
+}
+
+// Bounds in window pixels of the quads that aren't the same as last frame,
+// both where they were and where they are. False when that is everything.
+bool damaged_rect(int32_t *rect) {
+	float damage[4] = { self.view[2], self.view[3], 0.f, 0.f };
+	for (uint32_t i = 0; i < self.quad_count; i++) {
+		if (!memcmp(&self.quads[i], &self.last_quads[i], sizeof(Quad))) {
+			continue;
+		}
+		float b[4];
+		quad_bounds(&self.quads[i], b);
+		damage_add(damage, b);
+		quad_bounds(&self.last_quads[i], b);
+		damage_add(damage, b);
+	}
+	return damage_clip(damage, rect);
+}
+
+void quad_bounds(const Quad *q, float *b) {
+	float xs[4] = { q->x, q->x + q->ax, q->x + q->ax + q->bx, q->x + q->bx };
+	float ys[4] = { q->y, q->y + q->ay, q->y + q->ay + q->by, q->y + q->by };
+	b[0] = b[2] = xs[0];
+	b[1] = b[3] = ys[0];
+	for (int32_t i = 1; i < 4; i++) {
+		b[0] = xs[i] < b[0] ? xs[i] : b[0];
+		b[1] = ys[i] < b[1] ? ys[i] : b[1];
+		b[2] = xs[i] > b[2] ? xs[i] : b[2];
+		b[3] = ys[i] > b[3] ? ys[i] : b[3];
+	}
+}
+
+void renderer_flush() {
+	flush(FLUSH_EXPLICIT);
+}
+
+void flush(FlushReason reason) {
+	if (self.command_count) {
+		play_commands();
+	}
+	// Recorded quads wait for renderer_end_static or renderer_end_frame
+	if (self.recording || (self.deferring && !self.target)) {
+		return;
+	}
+	TRACE_BEGIN("renderer_flush");
+	Canvas canvas = current_canvas();
+	int32_t rect[4] = { 0, 0, canvas.width, canvas.height };
+	self.stats.flushes[reason] += self.quad_count > 0;
+	rasterize(self.quads, self.quad_count, canvas, rect);
+	self.quad_count = 0;
+	self.glyphs.flushed = self.glyphs.tick;
+	TRACE_END();
+}
+
+RendererStats renderer_get_stats() {
+	return self.stats;
+}
+
+StartupStats renderer_get_startup_stats() {
+	return self.startup;
+}
+
+FrameStats renderer_get_frame_stats() {
+	return (FrameStats){
+		.frame_cpu = timing_summary(&self.frame_cpu),
+		.flush_cpu = timing_summary(&self.flush_cpu),
+		.swap_cpu  = timing_summary(&self.swap_cpu) };
+}
+
+void renderer_log_stats(uint32_t frames) {
+	self.log_frames = frames;
+}
+
+void log_stats() {
+	RendererStats s = self.stats;
+	Timing cpu = timing_summary(&self.frame_cpu);
+	fprintf(stderr,
+		"frame %u: %u draws, %u quads, %u culled, "
+		"flushes %u explicit %u frame %u texture %u overflow %u state, "
+		"cpu %.2f ms p95 %.2f ms\n",
+		self.frame_count, s.draw_calls, s.quads_drawn, s.quads_culled,
+		s.flushes[FLUSH_EXPLICIT], s.flushes[FLUSH_FRAME], s.flushes[FLUSH_TEXTURE],
+		s.flushes[FLUSH_OVERFLOW], s.flushes[FLUSH_STATE],
+		cpu.last, cpu.p95);
+}
+
+void renderer_swap_buffers() {
+	double start = system_time();
+	system_swap_buffers();
+	timing_push(&self.swap_cpu, (float)((system_time() - start) * 1000.0));
+}
+
+void renderer_set_color(Color c) {
+	self.hot_color = pack_color(c);
+}
+
+void renderer_set_blend(BlendMode b) {
+	self.hot_blend = b;
+}
+
+void renderer_set_sorting(bool enabled) {
+	flush(FLUSH_STATE);
+	self.sorting = enabled;
+}
+
+void renderer_push_mat4() {
+	transform_push(&self.transform);
+}
+
+void renderer_pop_mat4() {
+	transform_pop(&self.transform);
+}
+
+void renderer_translate(float x, float y) {
+	transform_translate(&self.transform, x, y);
+}
+
+void renderer_scale(float sx, float sy) {
+	transform_mul(&self.transform, math_mat3x2_scale(sx, sy));
+}
+
+void renderer_rotate(float r) {
+	transform_mul(&self.transform, math_mat3x2_rotate(r));
+}
+
+void renderer_set_culling(bool enabled) {
+	self.culling = enabled;
+}
+
+void renderer_set_layer(uint8_t layer) {
+	self.hot_layer = layer;
+}
+
+void renderer_set_depth(uint16_t depth) {
+	self.hot_depth = depth;
+}
+
+void renderer_set_image(Image i) {
+	self.hot_texture = (uint16_t)i.id;
+	self.hot_uv[0] = i.u0;
+	self.hot_uv[1] = i.v0;
+	self.hot_uv[2] = i.u1 - i.u0;
+	self.hot_uv[3] = i.v1 - i.v0;
+}
+
+Typeface renderer_load_font(const char *filename) {
+	if (self.glyphs.font_count == MAX_FONTS) {
+		system_panic("Too many fonts");
+	}
+	// NOTE: stb_truetype reads from the file data for as long as the font lives
+	const PackEntry *e = pack_find(&self.pack, filename);
+	uint8_t *data = e ? (uint8_t *)self.pack.data + e->offset : system_load_file(filename, NULL);
+	if (!data || !glyph_add_font(&self.glyphs, data)) {
+		system_panic("Couldn't load font");
+	}
+
+	if (!self.glyph_texture) {
+		self.glyph_texture = new_texture(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 1);
+		glyph_cache_init(&self.glyphs, store_glyph);
+	}
+	return (Typeface){ self.glyphs.font_count };
+}
+
+void renderer_draw_text(Typeface font, const char *text, float x, float y, float size) {
+	renderer_draw_text_wrapped(font, text, x, y, size, 0.f);
+}
+
+// Laid out every time, what a layout cache would save is little next to
+// rasterizing the glyphs
+void renderer_draw_text_wrapped(Typeface font, const char *text, float x, float y, float size, float width) {
+	self.stats.text_misses++;
+	uint32_t count = glyph_layout(&self.glyphs, font.id, text, size, width);
+	for (uint32_t i = 0; i < count; i++) {
+		LaidGlyph *lg = &self.glyphs.scratch[i];
+		Glyph *g = glyph_resolve(&self.glyphs, font.id, lg);
+		Quad q = {
+			x + lg->x, y + lg->y, lg->w, 0.f, 0.f, lg->h,
+			g->u0, g->v0, g->u1, g->v1,
+			self.hot_color, (uint16_t)self.glyph_texture, self.hot_blend };
+		submit(&q);
+	}
+}
+
+Image renderer_load_image(const char *filename) {
+	Image img = load_image(filename);
+	if (!img.id) {
+		system_panic("Could't load image");
+	}
+	return img;
+}
+
+// Images from a file or the mounted pack, no image when the file can't be
+// read or decoded
+Image load_image(const char *filename) {
+	TRACE_BEGIN("renderer_load_image");
+	// Packed images were decoded when the pack was built
+	const PackEntry *e = pack_find(&self.pack, filename);
+	if (e && e->kind == PACK_PIXELS) {
+		Image img = renderer_mem_image(e->width, e->height, self.pack.data + e->offset);
+		TRACE_END();
+		return img;
+	}
+
+	size_t size = 0;
+	uint8_t *file = NULL;
+	const uint8_t *data = e ? self.pack.data + e->offset : NULL;
+	if (e) {
+		size = e->size;
+	}
+	else {
+		data = file = system_load_file(filename, &size);
+	}
+	if (data == NULL) {
+		TRACE_END();
+		return (Image){ 0 };
+	}
+
+	// Compressed textures are only ever sampled from their full size level
+	TexFile tex;
+	if (texfile_parse(&tex, data, size)) {
+		Image img = renderer_mem_image(tex.width, tex.height, NULL);
+		texfile_decode(&tex, 0, self.textures[img.id - 1].pixels);
+		free(file);
+		TRACE_END();
+		return img;
+	}
+
+	int32_t w, h, n;
+	uint8_t *pixels = stbi_load_from_memory(data, size, &w, &h, &n, 4); // Force RGBA
+	free(file);
+	if (pixels == NULL) {
+		TRACE_END();
+		return (Image){ 0 };
+	}
+	Image img = renderer_mem_image(w, h, pixels);
+	stbi_image_free(pixels);
+	TRACE_END();
+
+	return img;
+}
+
+bool renderer_mount_pack(const char *filename) {
+	size_t size = 0;
+	const void *data = system_map_file(filename, &size);
+	return data && pack_open(&self.pack, data, size);
+}
+
+// Decoding is the bulk of loading here, there is no upload to spread over
+// frames, so images are ready or failed when these return
+Image renderer_load_image_async(const char *filename, uint32_t group) {
+	Image img = load_image(filename);
+	if (!img.id) {
+		img = renderer_mem_image(1, 1, (uint8_t[]){0, 0, 0, 0});
+		self.textures[img.id - 1].failed = true;
+		self.textures[img.id - 1].group = group;
+	}
+	return img;
+}
+
+uint32_t renderer_images_pending(uint32_t group) {
+	(void)group;
+	return 0;
+}
+
+uint32_t renderer_images_failed(uint32_t group) {
+	uint32_t failed = 0;
+	for (uint32_t t = 0; t < MAX_TEXTURES; t++) {
+		failed += self.textures[t].failed && self.textures[t].group == group;
+	}
+	return failed;
+}
+
+void renderer_wait_images(uint32_t group) {
+	(void)group;
+}
+
+void renderer_set_upload_budget(uint32_t bytes) {
+	(void)bytes;
+}
+
+void renderer_free_image(Image i) {
+	// Pending quads may still sample from it
+	flush_now(FLUSH_TEXTURE);
+	Texture *t = &self.textures[i.id - 1];
+	free(t->pixels);
+	*t = (Texture){ 0 };
+	renderer_invalidate_frame();
+	if (self.hot_texture == i.id) {
+		renderer_set_image(self.pixel);
+	}
+}
+
+Image renderer_mem_image(int32_t width, int32_t height, const uint8_t *pixels) {
+	return renderer_create_image(width, height, pixels, (TextureDesc){ 0 });
+}
+
+// Everything is stored as RGBA8, the formats are expanded the way GL
+// swizzles them and sRGB texels are decoded here instead of when sampled
+Image renderer_create_image(int32_t width, int32_t height, const uint8_t *pixels, TextureDesc desc) {
+	static uint8_t linear[256];
+	if (desc.format == TEXTURE_SRGB8_ALPHA8 && !linear[255]) {
+		for (int32_t i = 0; i < 256; i++) {
+			float c = i / 255.f;
+			c = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			linear[i] = (uint8_t)(c * 255.f + .5f);
+		}
+	}
+
+	uint32_t id = new_texture(width, height, 4);
+	Texture *t = &self.textures[id - 1];
+	t->filter = desc.filter;
+	t->wrap = desc.wrap;
+	size_t count = (size_t)width * height;
+	uint8_t *dst = t->pixels;
+	for (size_t i = 0; pixels && i < count; i++, dst += 4) {
+		switch (desc.format) {
+			case TEXTURE_SRGB8_ALPHA8:
+				dst[0] = linear[pixels[i * 4 + 0]];
+				dst[1] = linear[pixels[i * 4 + 1]];
+				dst[2] = linear[pixels[i * 4 + 2]];
+				dst[3] = pixels[i * 4 + 3];
+				break;
+			case TEXTURE_R8:
+				dst[0] = dst[1] = dst[2] = 255;
+				dst[3] = pixels[i];
+				break;
+			case TEXTURE_RG8:
+				dst[0] = dst[1] = dst[2] = pixels[i * 2];
+				dst[3] = pixels[i * 2 + 1];
+				break;
+			default:
+				memcpy(dst, pixels + i * 4, 4);
+				break;
+		}
+	}
+	return (Image){
+		.id = id, .width = width, .height = height,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f };
+}
+
+uint32_t new_texture(int32_t width, int32_t height, uint32_t channels) {
+	uint32_t t = 0;
+	while (t < MAX_TEXTURES && self.textures[t].pixels) {
+		t++;
+	}
+	if (t == MAX_TEXTURES) {
+		system_panic("Too many images");
+	}
+	size_t size = (size_t)width * height * channels;
+	self.textures[t] = (Texture){
+		.pixels = calloc(size ? size : 1, 1),
+		.width = width, .height = height, .channels = channels };
+	return t + 1;
+}
+
+Image renderer_create_target(int32_t width, int32_t height, bool cached) {
+	uint32_t id = new_texture(width, height, 4);
+	Texture *t = &self.textures[id - 1];
+	t->target = true;
+	t->cached = cached;
+	t->dirty = true;
+	return (Image){
+		.id = id, .width = width, .height = height,
+		.u0 = 0.f, .v0 = 0.f, .u1 = 1.f, .v1 = 1.f };
+}
+
+bool renderer_begin_target(Image image) {
+	assert(!self.target);
+	Texture *t = &self.textures[image.id - 1];
+	assert(t->target);
+	if (t->cached && !t->dirty) {
+		self.stats.targets_cached++;
+		return false;
+	}
+	self.stats.targets_drawn++;
+
+	// Whatever was pushed so far goes to the window, a deferred frame
+	// included as it may sample the target before it gets redrawn
+	flush_now(FLUSH_STATE);
+	self.target = image.id;
+	memcpy(self.window_view, self.view, sizeof(self.view));
+	self.window_transform = self.transform.m;
+	self.window_transform_kind = self.transform.kind;
+
+	self.view[0] = 0.f;
+	self.view[1] = 0.f;
+	self.view[2] = (float)t->width;
+	self.view[3] = (float)t->height;
+	self.transform.m = math_mat3x2_identity();
+	self.transform.kind = TRANSFORM_IDENTITY;
+	self.frame_dirty = true;
+
+	int32_t rect[4] = { 0, 0, t->width, t->height };
+	clear_canvas(current_canvas(), rect, 0);
+	return true;
+}
+
+void renderer_end_target() {
+	assert(self.target);
+	flush(FLUSH_STATE);
+	self.textures[self.target - 1].dirty = false;
+	self.target = 0;
+
+	memcpy(self.view, self.window_view, sizeof(self.view));
+	self.transform.m = self.window_transform;
+	self.transform.kind = self.window_transform_kind;
+}
+
+void renderer_invalidate_target(Image image) {
+	self.textures[image.id - 1].dirty = true;
+}
+
+// The target being drawn into, or the window frame
+Canvas current_canvas() {
+	if (self.target) {
+		Texture *t = &self.textures[self.target - 1];
+		return (Canvas){ (uint32_t *)t->pixels, t->width, t->height };
+	}
+	return (Canvas){ self.frame, self.frame_width, self.frame_height };
+}
+
+void renderer_push_quad(float x1, float y1, float x2, float y2, float u0, float u1, float v0, float v1) {
+	// Texture coordinates are relative to the image, not its texture
+	Quad q = {
+		x1, y1, x2 - x1, 0.f, 0.f, y2 - y1,
+		self.hot_uv[0] + u0 * self.hot_uv[2], self.hot_uv[1] + v0 * self.hot_uv[3],
+		self.hot_uv[0] + u1 * self.hot_uv[2], self.hot_uv[1] + v1 * self.hot_uv[3],
+		self.hot_color, self.hot_texture, self.hot_blend };
+	submit(&q);
+}
+
+void renderer_push_quads(const Sprite *sprites, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		const Sprite *sp = &sprites[i];
+		Quad q = {
+			sp->x, sp->y, sp->w, 0.f, 0.f, sp->h,
+			self.hot_uv[0] + sp->u0 * self.hot_uv[2], self.hot_uv[1] + sp->v0 * self.hot_uv[3],
+			self.hot_uv[0] + sp->u1 * self.hot_uv[2], self.hot_uv[1] + sp->v1 * self.hot_uv[3],
+			pack_color(sp->color), self.hot_texture, self.hot_blend };
+		submit(&q);
+	}
+}
+
+void renderer_begin_static() {
+	// Nothing pushed before belongs to the batch
+	flush(FLUSH_STATE);
+	assert(!self.recording);
+	self.recording = true;
+	self.recording_culling = self.culling;
+	self.recording_sorting = self.sorting;
+	self.culling = false;
+	self.sorting = false;
+	self.static_from = self.quad_count;
+}
+
+StaticBatch renderer_end_static() {
+	self.recording = false;
+	self.culling = self.recording_culling;
+	self.sorting = self.recording_sorting;
+
+	uint32_t id = 0;
+	while (id < MAX_STATIC_BATCHES && self.statics[id].live) {
+		id++;
+	}
+	if (id == MAX_STATIC_BATCHES) {
+		system_panic("Too many static batches");
+	}
+
+	StaticData *b = &self.statics[id];
+	b->live = true;
+	b->count = self.quad_count - self.static_from;
+	b->quads = malloc((b->count ? b->count : 1) * sizeof(Quad));
+	memcpy(b->quads, self.quads + self.static_from, b->count * sizeof(Quad));
+	self.quad_count = self.static_from;
+	self.frame_dirty = true;
+	return (StaticBatch){ id + 1 };
+}
+
+// The batch is only transformed again, quads are the cheap part here
+void renderer_draw_static(StaticBatch batch) {
+	// Keeps the batch in order with what was pushed before it
+	if (self.command_count) {
+		play_commands();
+	}
+	StaticData *b = &self.statics[batch.id - 1];
+	Quad *q = reserve(b->count);
+	memcpy(q, b->quads, b->count * sizeof(Quad));
+	if (self.transform.kind != TRANSFORM_IDENTITY) {
+		for (uint32_t i = 0; i < b->count; i++) {
+			transform_quad(&self.transform, &q[i].x);
+		}
+	}
+	self.quad_count += b->count;
+	self.stats.quads_drawn += b->count;
+}
+
+void renderer_free_static(StaticBatch batch) {
+	StaticData *b = &self.statics[batch.id - 1];
+	free(b->quads);
+	*b = (StaticData){ 0 };
+	self.frame_dirty = true;
+}
+
+// Blending is the only vectorized part, quads are set up one at a time
+SimdLevel renderer_set_simd(SimdLevel level) {
+#ifdef NEKO_SIMD_X86
+	__builtin_cpu_init();
+	if (level > SIMD_SSE2) {
+		level = SIMD_SSE2;
+	}
+	if (level == SIMD_SSE2 && !__builtin_cpu_supports("sse2")) {
+		level = SIMD_NONE;
+	}
+#else
+	level = SIMD_NONE;
+#endif
+	self.simd = level;
+	return level;
+}
+
+// Transforms a quad and either queues it or records it for sorting
+void submit(Quad *q) {
+	transform_quad(&self.transform, &q->x);
+	if (self.culling && !quad_visible(q)) {
+		self.stats.quads_culled++;
+		return;
+	}
+	self.stats.quads_drawn++;
+
+	if (!self.sorting) {
+		*reserve(1) = *q;
+		self.quad_count++;
+		return;
+	}
+
+	if (self.command_count == MAX_COMMANDS) {
+		flush(FLUSH_OVERFLOW);
+	}
+	uint32_t i = self.command_count++;
+	self.commands[i] = *q;
+	self.keys[i] = (uint64_t)self.hot_layer << 56
+		| (uint64_t)self.hot_depth << 40
+		| (uint64_t)q->blend << 36
+		| (uint64_t)q->texture << 16
+		| i;
+}
+
+// Room for `count` more quads at the end of `quads`
+Quad *reserve(uint32_t count) {
+	if (self.quad_count + count > self.quad_size) {
+		while (self.quad_count + count > self.quad_size) {
+			self.quad_size = self.quad_size ? self.quad_size * 2 : 4096;
+		}
+		self.quads = realloc(self.quads, self.quad_size * sizeof(Quad));
+	}
+	return self.quads + self.quad_count;
+}
+
+// Whether a transformed quad overlaps the view at all
+bool quad_visible(const Quad *q) {
+	return quad_in_view(&q->x, self.view);
+}
+
+void play_commands() {
+	uint32_t count = self.command_count;
+	self.command_count = 0;
+	sort_keys(self.keys, self.sort_tmp, count);
+
+	Quad *q = reserve(count);
+	for (uint32_t i = 0; i < count; i++) {
+		q[i] = self.commands[self.keys[i] & 0xFFFF];
+	}
+	self.quad_count += count;
+}
+
+void clear_canvas(Canvas c, const int32_t *rect, uint32_t color) {
+	for (int32_t y = rect[1]; y < rect[3]; y++) {
+		uint32_t *row = c.pixels + (size_t)y * c.width;
+		for (int32_t x = rect[0]; x < rect[2]; x++) {
+			row[x] = color;
+		}
+	}
+}
+
+// Pixels whose centers a quad covers, clipped to `clip`. False if none.
+static bool quad_pixels(const Quad *q, const int32_t *clip, int32_t *r) {
+	float b[4];
+	quad_bounds(q, b);
+	r[0] = (int32_t)ceilf(b[0] - .5f);
+	r[1] = (int32_t)ceilf(b[1] - .5f);
+	r[2] = (int32_t)ceilf(b[2] - .5f);
+	r[3] = (int32_t)ceilf(b[3] - .5f);
+	r[0] = r[0] > clip[0] ? r[0] : clip[0];
+	r[1] = r[1] > clip[1] ? r[1] : clip[1];
+	r[2] = r[2] < clip[2] ? r[2] : clip[2];
+	r[3] = r[3] < clip[3] ? r[3] : clip[3];
+	return r[0] < r[2] && r[1] < r[3];
+}
+
+// Bins the quads into the tiles they touch and fills the tiles, with the
+// workers when there is enough to share. Returns once all of it is drawn.
+void rasterize(const Quad *quads, uint32_t count, Canvas canvas, const int32_t *clip) {
+	if (count == 0 || clip[0] >= clip[2] || clip[1] >= clip[3]) {
+		return;
+	}
+	self.stats.draw_calls++;
+	double start = system_time();
+
+	int32_t tiles_x = (canvas.width + TILE_SIZE - 1) / TILE_SIZE;
+	int32_t tiles_y = (canvas.height + TILE_SIZE - 1) / TILE_SIZE;
+	uint32_t tiles = (uint32_t)(tiles_x * tiles_y);
+	if (tiles + 1 > self.bin_offsets_size) {
+		self.bin_offsets_size = tiles + 1;
+		self.bin_offsets = realloc(self.bin_offsets, self.bin_offsets_size * sizeof(uint32_t));
+	}
+	if (count > self.bin_ranges_size) {
+		self.bin_ranges_size = count;
+		self.bin_ranges = realloc(self.bin_ranges, count * sizeof(uint64_t));
+	}
+
+	// Count the quads of each tile, keeping the tiles each quad spans
+	uint32_t *offsets = self.bin_offsets;
+	memset(offsets, 0, (tiles + 1) * sizeof(uint32_t));
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		int32_t r[4];
+		if (!quad_pixels(&quads[i], clip, r)) {
+			self.bin_ranges[i] = 0;
+			continue;
+		}
+		uint64_t tx0 = r[0] / TILE_SIZE, ty0 = r[1] / TILE_SIZE;
+		uint64_t tx1 = (r[2] - 1) / TILE_SIZE + 1, ty1 = (r[3] - 1) / TILE_SIZE + 1;
+		self.bin_ranges[i] = tx0 | ty0 << 16 | tx1 << 32 | ty1 << 48;
+		for (uint64_t ty = ty0; ty < ty1; ty++) {
+			for (uint64_t tx = tx0; tx < tx1; tx++) {
+				offsets[ty * tiles_x + tx]++;
+			}
+		}
+		total += (uint32_t)((tx1 - tx0) * (ty1 - ty0));
+	}
+	if (total > self.bin_quads_size) {
+		self.bin_quads_size = total;
+		self.bin_quads = realloc(self.bin_quads, total * sizeof(uint32_t));
+	}
+	for (uint32_t t = 0, sum = 0; t <= tiles; t++) {
+		uint32_t n = offsets[t];
+		offsets[t] = sum;
+		sum += n;
+	}
+	// Filling moves the offset of each tile to where it ends, which is
+	// also where the next one starts
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t range = self.bin_ranges[i];
+		uint32_t tx0 = range & 0xFFFF, ty0 = range >> 16 & 0xFFFF;
+		uint32_t tx1 = range >> 32 & 0xFFFF, ty1 = range >> 48;
+		for (uint32_t ty = ty0; ty < ty1; ty++) {
+			for (uint32_t tx = tx0; tx < tx1; tx++) {
+				self.bin_quads[offsets[ty * tiles_x + tx]++] = i;
+			}
+		}
+	}
+
+	self.raster_quads = quads;
+	self.raster_canvas = canvas;
+	memcpy(self.raster_clip, clip, sizeof(self.raster_clip));
+	self.tiles_x = tiles_x;
+	self.tile_count = tiles;
+	self.next_tile = 0;
+
+	uint32_t workers = count >= RASTER_MIN_QUADS ? self.raster_threads - 1 : 0;
+	for (uint32_t t = 0; t < workers; t++) {
+		system_post(self.raster_start);
+	}
+	raster_tiles();
+	for (uint32_t t = 0; t < workers; t++) {
+		system_wait(self.raster_done);
+	}
+	timing_push(&self.flush_cpu, (float)((system_time() - start) * 1000.0));
+}
+
+void raster_worker(void *arg) {
+	(void)arg;
+	TRACE_THREAD("raster");
+	for (;;) {
+		system_wait(self.raster_start);
+		raster_tiles();
+		system_post(self.raster_done);
+	}
+}
+
+// Takes tiles until there are none left and draws their quads in order
+void raster_tiles() {
+	TRACE_BEGIN("raster tiles");
+	for (;;) {
+		system_lock(self.raster_mutex);
+		uint32_t t = self.next_tile++;
+		system_unlock(self.raster_mutex);
+		if (t >= self.tile_count) {
+			TRACE_END();
+			return;
+		}
+		uint32_t first = t ? self.bin_offsets[t - 1] : 0;
+		uint32_t last = self.bin_offsets[t];
+		if (first == last) {
+			continue;
+		}
+
+		int32_t x = (int32_t)(t % self.tiles_x) * TILE_SIZE;
+		int32_t y = (int32_t)(t / self.tiles_x) * TILE_SIZE;
+		const int32_t *clip = self.raster_clip;
+		int32_t rect[4] = {
+			x > clip[0] ? x : clip[0],
+			y > clip[1] ? y : clip[1],
+			x + TILE_SIZE < clip[2] ? x + TILE_SIZE : clip[2],
+			y + TILE_SIZE < clip[3] ? y + TILE_SIZE : clip[3] };
+		for (uint32_t i = first; i < last; i++) {
+			draw_quad(&self.raster_quads[self.bin_quads[i]], rect);
+		}
+	}
+}
+
+static inline int32_t ifloor(float f) {
+	int32_t i = (int32_t)f;
+	return i - (f < (float)i);
+}
+
+static inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static inline int32_t wrap_coord(int32_t i, int32_t size, TextureWrap wrap) {
+	if (i >= 0 && i < size) {
+		return i;
+	}
+	if (wrap == WRAP_CLAMP) {
+		return i < 0 ? 0 : size - 1;
+	}
+	if (wrap == WRAP_MIRROR) {
+		int32_t period = size * 2;
+		i %= period;
+		i = i < 0 ? i + period : i;
+		return i < size ? i : period - 1 - i;
+	}
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+// Mixes two RGBA8 texels, `w` goes from 0 (all `a`) to 256 (all `b`)
+static inline uint32_t lerp_texel(uint32_t a, uint32_t b, uint32_t w) {
+	uint32_t rb = ((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8 & 0xFF00FF;
+	uint32_t ga = ((a >> 8 & 0xFF00FF) * (256 - w) + (b >> 8 & 0xFF00FF) * w) >> 8 & 0xFF00FF;
+	return rb | ga << 8;
+}
+
+static inline uint32_t tint_texel(uint32_t texel, uint32_t color) {
+	if (color == 0xFFFFFFFFu) {
+		return texel;
+	}
+	uint32_t out = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 8) {
+		out |= div255((texel >> shift & 0xFF) * (color >> shift & 0xFF)) << shift;
+	}
+	return out;
+}
+
+// Narrows the pixels [lo, hi) of a row to those where `v + dv * x`, the
+// position across one of the quad edges, stays within 0 and 1
+static inline bool span_limit(float v, float dv, float *lo, float *hi) {
+	if (dv == 0.f) {
+		return v >= 0.f && v < 1.f;
+	}
+	float a = -v / dv;
+	float b = (1.f - v) / dv;
+	if (dv < 0.f) {
+		float swap = a;
+		a = b;
+		b = swap;
+	}
+	*lo = a > *lo ? a : *lo;
+	*hi = b < *hi ? b : *hi;
+	return *lo < *hi;
+}
+
+// Draws the part of a quad inside `rect`, which is within a single tile.
+// Every row inverts the quad edges to find its span, then samples it into
+// `texels` and blends that in.
+void draw_quad(const Quad *q, const int32_t *rect) {
+	const Texture *t = &self.textures[q->texture - 1];
+	float det = q->ax * q->by - q->ay * q->bx;
+	// Freed images draw nothing, like a deleted texture would
+	if (!t->pixels || det == 0.f) {
+		return;
+	}
+
+	// (s, t) is where a pixel falls along each edge, 0 to 1 inside the quad
+	float inv = 1.f / det;
+	float sx = q->by * inv, sy = -q->bx * inv;
+	float tx = -q->ay * inv, ty = q->ax * inv;
+	float du = (q->u1 - q->u0) * t->width;
+	float dv = (q->v1 - q->v0) * t->height;
+
+	// How many texels a pixel covers, what the glyph edges get smoothed over
+	float sdf_scale = 0.f, sdf_bias = 0.f;
+	if (t->channels == 1) {
+		float fw_u = (fabsf(sx) + fabsf(sy)) * fabsf(du);
+		float fw_v = (fabsf(tx) + fabsf(ty)) * fabsf(dv);
+		float m = fw_u < fw_v ? fw_u : fw_v;
+		sdf_scale = 1.f / (GLYPH_DIST_SCALE * m);
+		sdf_bias = GLYPH_DIST_SCALE * m * .5f - GLYPH_ON_EDGE;
+	}
+	bool solid = t->width == 1 && t->height == 1 && t->channels == 4;
+	uint32_t solid_texel = solid ? tint_texel(*(const uint32_t *)t->pixels, q->color) : 0;
+	BlendMode mode = (BlendMode)q->blend;
+
+	// (s, t) and the texel position are planes over the pixel coordinates,
+	// evaluated at each pixel rather than stepped from the start of the
+	// tile, so a pixel comes out the same whichever tile or clip draws it
+	float s_x0 = (.5f - q->x) * sx + (.5f - q->y) * sy;
+	float t_x0 = (.5f - q->x) * tx + (.5f - q->y) * ty;
+	float u_x0 = q->u0 * t->width + s_x0 * du;
+	float v_x0 = q->v0 * t->height + t_x0 * dv;
+
+	Canvas c = self.raster_canvas;
+	uint32_t texels[TILE_SIZE];
+	for (int32_t y = rect[1]; y < rect[3]; y++) {
+		float s_row = s_x0 + y * sy;
+		float t_row = t_x0 + y * ty;
+		float lo = (float)rect[0], hi = (float)rect[2];
+		if (!span_limit(s_row, sx, &lo, &hi) || !span_limit(t_row, tx, &lo, &hi)) {
+			continue;
+		}
+		int32_t first = (int32_t)ceilf(lo);
+		int32_t last = (int32_t)ceilf(hi);
+		last = last < rect[2] ? last : rect[2];
+		int32_t n = last - first;
+		if (n <= 0) {
+			continue;
+		}
+		uint32_t *dst = c.pixels + (size_t)y * c.width + first;
+
+		if (solid) {
+			// Opaque fills don't need to read what is under them
+			if ((mode == BLEND_ALPHA || mode == BLEND_PREMULTIPLIED) && solid_texel >> 24 == 0xFF) {
+				for (int32_t i = 0; i < n; i++) {
+					dst[i] = solid_texel;
+				}
+				continue;
+			}
+			for (int32_t i = 0; i < n; i++) {
+				texels[i] = solid_texel;
+			}
+			blend_span(dst, texels, n, mode);
+			continue;
+		}
+
+		float u_row = u_x0 + y * sy * du;
+		float v_row = v_x0 + y * ty * dv;
+		float step_u = sx * du;
+		float step_v = tx * dv;
+		int32_t w = t->width, h = t->height;
+		if (t->channels == 1) {
+			const uint8_t *p = t->pixels;
+			uint32_t rgb = q->color & 0xFFFFFF;
+			float alpha = (float)(q->color >> 24);
+			for (int32_t i = 0; i < n; i++) {
+				float u = u_row + (first + i) * step_u;
+				float v = v_row + (first + i) * step_v;
+				float fx = u - .5f, fy = v - .5f;
+				int32_t x0 = ifloor(fx), y0 = ifloor(fy);
+				float wx = fx - x0, wy = fy - y0;
+				int32_t xa = wrap_coord(x0, w, t->wrap), xb = wrap_coord(x0 + 1, w, t->wrap);
+				int32_t ya = wrap_coord(y0, h, t->wrap) * w, yb = wrap_coord(y0 + 1, h, t->wrap) * w;
+				float top = p[ya + xa] + (p[ya + xb] - p[ya + xa]) * wx;
+				float bottom = p[yb + xa] + (p[yb + xb] - p[yb + xa]) * wx;
+				float a = ((top + (bottom - top) * wy) + sdf_bias) * sdf_scale;
+				a = a < 0.f ? 0.f : (a > 1.f ? 1.f : a);
+				texels[i] = rgb | (uint32_t)(a * alpha + .5f) << 24;
+			}
+		}
+		else if (t->filter == FILTER_NEAREST) {
+			const uint32_t *p = (const uint32_t *)t->pixels;
+			for (int32_t i = 0; i < n; i++) {
+				float u = u_row + (first + i) * step_u;
+				float v = v_row + (first + i) * step_v;
+				int32_t x0 = wrap_coord(ifloor(u), w, t->wrap);
+				int32_t y0 = wrap_coord(ifloor(v), h, t->wrap);
+				texels[i] = tint_texel(p[y0 * w + x0], q->color);
+			}
+		}
+		else {
+			const uint32_t *p = (const uint32_t *)t->pixels;
+			for (int32_t i = 0; i < n; i++) {
+				float u = u_row + (first + i) * step_u;
+				float v = v_row + (first + i) * step_v;
+				float fx = u - .5f, fy = v - .5f;
+				int32_t x0 = ifloor(fx), y0 = ifloor(fy);
+				uint32_t wx = (uint32_t)((fx - x0) * 256.f);
+				uint32_t wy = (uint32_t)((fy - y0) * 256.f);
+				int32_t xa = wrap_coord(x0, w, t->wrap), xb = wrap_coord(x0 + 1, w, t->wrap);
+				int32_t ya = wrap_coord(y0, h, t->wrap) * w, yb = wrap_coord(y0 + 1, h, t->wrap) * w;
+				uint32_t top = lerp_texel(p[ya + xa], p[ya + xb], wx);
+				uint32_t bottom = lerp_texel(p[yb + xa], p[yb + xb], wx);
+				texels[i] = tint_texel(lerp_texel(top, bottom, wy), q->color);
+			}
+		}
+		blend_span(dst, texels, n, mode);
+	}
+}
+
+// Every mode is `src * Fs + dst * Fd` per channel, rounded and saturated
+// like the GL blend units do. Their factors:
+//   ALPHA          rgb: Sa, 1 - Sa     alpha: 1, 1 - Sa
+//   ADDITIVE       rgb: Sa, 1          alpha: 0, 1
+//   MULTIPLY       rgb: D, 1 - Sa      alpha: 0, 1
+//   PREMULTIPLIED  all: 1, 1 - Sa
+static inline uint32_t blend_pixel(uint32_t s, uint32_t d, BlendMode mode) {
+	uint32_t sa = s >> 24;
+	uint32_t out = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 8) {
+		uint32_t sc = s >> shift & 0xFF;
+		uint32_t dc = d >> shift & 0xFF;
+		bool alpha = shift == 24;
+		uint32_t fs, fd;
+		switch (mode) {
+			case BLEND_ADDITIVE:      fs = alpha ? 0 : sa;    fd = 255; break;
+			case BLEND_MULTIPLY:      fs = alpha ? 0 : dc;    fd = alpha ? 255 : 255 - sa; break;
+			case BLEND_PREMULTIPLIED: fs = 255;               fd = 255 - sa; break;
+			default:                  fs = alpha ? 255 : sa;  fd = 255 - sa; break;
+		}
+		uint32_t c = div255(sc * fs) + div255(dc * fd);
+		out |= (c < 255 ? c : 255) << shift;
+	}
+	return out;
+}
+
+static void blend_span_scalar(uint32_t *dst, const uint32_t *src, int32_t n, BlendMode mode) {
+	for (int32_t i = 0; i < n; i++) {
+		dst[i] = blend_pixel(src[i], dst[i], mode);
+	}
+}
+
+#ifdef NEKO_SIMD_X86
+// NOTE(ellora): Pixels are widened to 16 bit lanes, two per register, and
+// go through the same factors and rounding as blend_pixel so both paths
+// write the very same bytes.
+#define SSE2 __attribute__((target("sse2"), always_inline)) static inline
+
+// a * b / 255 rounded, for lanes holding bytes
+SSE2 __m128i mul_div255(__m128i a, __m128i b) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+SSE2 __m128i blend_lanes(__m128i s, __m128i d, BlendMode mode) {
+	const __m128i full = _mm_set1_epi16(255);
+	const __m128i alpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	__m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	__m128i inv = _mm_sub_epi16(full, sa);
+	__m128i fs, fd;
+	switch (mode) {
+		case BLEND_ADDITIVE:
+			fs = _mm_andnot_si128(alpha, sa);
+			fd = full;
+			break;
+		case BLEND_MULTIPLY:
+			fs = _mm_andnot_si128(alpha, d);
+			fd = _mm_or_si128(_mm_andnot_si128(alpha, inv), _mm_and_si128(alpha, full));
+			break;
+		case BLEND_PREMULTIPLIED:
+			fs = full;
+			fd = inv;
+			break;
+		default:
+			fs = _mm_or_si128(_mm_andnot_si128(alpha, sa), _mm_and_si128(alpha, full));
+			fd = inv;
+			break;
+	}
+	return _mm_adds_epu16(mul_div255(s, fs), mul_div255(d, fd));
+}
+
+__attribute__((target("sse2")))
+static void blend_span_sse2(uint32_t *dst, const uint32_t *src, int32_t n, BlendMode mode) {
+	const __m128i zero = _mm_setzero_si128();
+	int32_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i lo = blend_lanes(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), mode);
+		__m128i hi = blend_lanes(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), mode);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	blend_span_scalar(dst + i, src + i, n - i, mode);
+}
+#endif
+
+void blend_span(uint32_t *dst, const uint32_t *src, int32_t n, BlendMode mode) {
+#ifdef NEKO_SIMD_X86
+	if (self.simd >= SIMD_SSE2) {
+		blend_span_sse2(dst, src, n, mode);
+		return;
+	}
+#endif
+	blend_span_scalar(dst, src, n, mode);
+}
+
+// Writes a glyph cell into the atlas, flushing first if quads still pending
+// sample the glyph it replaces
+void store_glyph(int32_t x, int32_t y, const uint8_t *texels, const Glyph *old) {
+	if (old) {
+		if (old->last_used > self.glyphs.flushed) {
+			flush_now(FLUSH_TEXTURE);
+		}
+		self.stats.glyph_evictions++;
+	}
+	if (texels) {
+		uint8_t *dst = self.textures[self.glyph_texture - 1].pixels + y * GLYPH_ATLAS_SIZE + x;
+		for (int32_t row = 0; row < GLYPH_CELL; row++) {
+			memcpy(dst + row * GLYPH_ATLAS_SIZE, texels + row * GLYPH_CELL, GLYPH_CELL);
+		}
+	}
+	self.stats.glyphs_rasterized++;
+	self.frame_dirty = true;
+}
+
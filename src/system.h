@@ -8,15 +8,44 @@
 #include "math.h"
 #include <stdbool.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 void  system_create_window(int32_t width, int32_t height, const char *name);
 void  system_sleep(uint32_t miliseconds);
+double system_time();
 void  system_close_window();
 bool  system_window_should_close();
 vec2  system_window_size();
 bool  system_window_is_visible();
+// True once after the window lost what it showed (uncovered, restored or
+// resized), the next frame has to be drawn whole even if it didn't change
+bool  system_window_damaged();
 void  system_swap_buffers();
+// RGBA8 pixels, top row first, that system_swap_buffers shows from then on
+// instead of what GL drew. The software renderer draws into memory and
+// hands its frame over here, NULL goes back to GL.
+void  system_set_framebuffer(const uint8_t *pixels, int32_t width, int32_t height);
 void  system_panic(const char *msg);
-void *system_load_file(const char *filename);
+// Returns the whole file plus a terminating zero, `size` may be NULL
+void *system_load_file(const char *filename, size_t *size);
+// Maps the file read only for the rest of the program, NULL if it can't
+const void *system_map_file(const char *filename, size_t *size);
+// Per user directory for files worth keeping between runs, created when
+// missing and ending in a separator. Empty when there is none.
+const char *system_cache_dir();
+// Moves `from` over `to` in one step, readers see either file whole
+bool  system_replace_file(const char *from, const char *to);
+
+// Cores the program can run on right now, at least 1
+uint32_t system_cpu_count();
+// Threads run until `entry` returns and are never joined, mutexes and
+// semaphores live as long as the program does
+void  system_create_thread(void (*entry)(void *arg), void *arg);
+void *system_create_mutex();
+void  system_lock(void *mutex);
+void  system_unlock(void *mutex);
+void *system_create_semaphore();
+void  system_post(void *semaphore);
+void  system_wait(void *semaphore);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,583 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <string.h>
+
+#include "texfile.h"
+
+#define FOURCC(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+// The largest texture GL 3.3 drivers commonly take
+#define MAX_SIZE (1 << 14)
+
+static const uint8_t ktx2_id[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static uint32_t read32(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t read64(const uint8_t *p) {
+	return read32(p) | (uint64_t)read32(p + 4) << 32;
+}
+
+uint32_t texfile_block_size(TexFormat format) {
+	return format == TEXFILE_BC1 || format == TEXFILE_ETC2_RGB ? 8 : 16;
+}
+
+// In 64 bits so a huge header can't wrap it around and pass the bounds checks
+static uint64_t level_size(const TexFile *t, uint32_t level) {
+	int32_t w = t->width >> level;
+	int32_t h = t->height >> level;
+	w = w > 0 ? w : 1;
+	h = h > 0 ? h : 1;
+	return (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * texfile_block_size(t->format);
+}
+
+static bool valid_size(const TexFile *t) {
+	return t->width > 0 && t->height > 0 && t->width <= MAX_SIZE && t->height <= MAX_SIZE;
+}
+
+// DDS keeps the levels one after the other, with either a legacy FourCC or
+// a DX10 header telling the format
+static bool parse_dds(TexFile *t, const uint8_t *data, size_t size) {
+	if (size < 128) {
+		return false;
+	}
+	t->height = read32(data + 12);
+	t->width = read32(data + 16);
+	uint32_t levels = read32(data + 8) & 0x20000 ? read32(data + 28) : 1;
+	uint32_t fourcc = read32(data + 84);
+	size_t offset = 128;
+
+	if (fourcc == FOURCC('D', 'X', 'T', '1')) {
+		t->format = TEXFILE_BC1;
+	}
+	else if (fourcc == FOURCC('D', 'X', 'T', '5')) {
+		t->format = TEXFILE_BC3;
+	}
+	else if (fourcc == FOURCC('D', 'X', '1', '0') && size >= 148) {
+		switch (read32(data + 128)) {
+			case 71: case 72: t->format = TEXFILE_BC1; break;
+			case 77: case 78: t->format = TEXFILE_BC3; break;
+			case 98: case 99: t->format = TEXFILE_BC7; break;
+			default: return false;
+		}
+		offset = 148;
+	}
+	else {
+		return false;
+	}
+	if (!valid_size(t)) {
+		return false;
+	}
+
+	levels = levels > 0 ? levels : 1;
+	t->level_count = levels < TEXFILE_MAX_LEVELS ? levels : TEXFILE_MAX_LEVELS;
+	for (uint32_t l = 0; l < t->level_count; l++) {
+		uint64_t n = level_size(t, l);
+		if (n > size - offset) {
+			return false;
+		}
+		t->levels[l] = (TexLevel){ data + offset, (uint32_t)n };
+		offset += n;
+	}
+	return true;
+}
+
+// KTX2 has an index with where each level is, formats are Vulkan ones
+static bool parse_ktx2(TexFile *t, const uint8_t *data, size_t size) {
+	if (size < 80 || memcmp(data, ktx2_id, sizeof(ktx2_id))) {
+		return false;
+	}
+	switch (read32(data + 12)) {
+		case 131: case 132: case 133: case 134: t->format = TEXFILE_BC1; break;
+		case 137: case 138: t->format = TEXFILE_BC3; break;
+		case 145: case 146: t->format = TEXFILE_BC7; break;
+		case 147: case 148: t->format = TEXFILE_ETC2_RGB; break;
+		case 151: case 152: t->format = TEXFILE_ETC2_RGBA; break;
+		default: return false;
+	}
+	t->width = read32(data + 20);
+	t->height = read32(data + 24);
+	uint32_t levels = read32(data + 40);
+	// Supercompressed levels would need inflating first
+	if (!valid_size(t) || read32(data + 44) != 0) {
+		return false;
+	}
+
+	levels = levels > 0 ? levels : 1;
+	if (levels > TEXFILE_MAX_LEVELS || 80 + levels * 24 > size) {
+		return false;
+	}
+	t->level_count = levels;
+	for (uint32_t l = 0; l < levels; l++) {
+		uint64_t offset = read64(data + 80 + l * 24);
+		uint64_t length = read64(data + 88 + l * 24);
+		uint64_t n = level_size(t, l);
+		if (length < n || offset > size || n > size - offset) {
+			return false;
+		}
+		t->levels[l] = (TexLevel){ data + offset, (uint32_t)n };
+	}
+	return true;
+}
+
+bool texfile_parse(TexFile *t, const uint8_t *data, size_t size) {
+	*t = (TexFile){ 0 };
+	if (size >= 4 && read32(data) == FOURCC('D', 'D', 'S', ' ')) {
+		return parse_dds(t, data, size);
+	}
+	return parse_ktx2(t, data, size);
+}
+
+static uint8_t clamp255(int32_t v) {
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Widens an `n` bits value to 8 bits by repeating its top bits
+static uint8_t extend(uint32_t v, uint32_t n) {
+	return v << (8 - n) | v >> (2 * n - 8);
+}
+
+// Blocks decode into 16 RGBA texels in row order
+
+static void decode_bc1(const uint8_t *b, uint8_t (*out)[4], bool four_colors) {
+	uint32_t c0 = b[0] | b[1] << 8;
+	uint32_t c1 = b[2] | b[3] << 8;
+	uint8_t colors[4][4] = {
+		{ extend(c0 >> 11, 5), extend(c0 >> 5 & 63, 6), extend(c0 & 31, 5), 255 },
+		{ extend(c1 >> 11, 5), extend(c1 >> 5 & 63, 6), extend(c1 & 31, 5), 255 },
+		{ 0, 0, 0, 255 },
+		{ 0, 0, 0, 255 },
+	};
+	for (uint32_t c = 0; c < 3; c++) {
+		if (c0 > c1 || four_colors) {
+			colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+			colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+		}
+		else {
+			colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+			colors[3][3] = 0;
+		}
+	}
+
+	uint32_t indices = read32(b + 4);
+	for (uint32_t i = 0; i < 16; i++) {
+		memcpy(out[i], colors[indices >> 2 * i & 3], 4);
+	}
+}
+
+static void decode_bc3_alpha(const uint8_t *b, uint8_t (*out)[4]) {
+	int32_t a[8] = { b[0], b[1] };
+	if (a[0] > a[1]) {
+		for (int32_t i = 1; i < 7; i++) {
+			a[i + 1] = ((7 - i) * a[0] + i * a[1]) / 7;
+		}
+	}
+	else {
+		for (int32_t i = 1; i < 5; i++) {
+			a[i + 1] = ((5 - i) * a[0] + i * a[1]) / 5;
+		}
+		a[6] = 0;
+		a[7] = 255;
+	}
+
+	uint64_t indices = read64(b) >> 16;
+	for (uint32_t i = 0; i < 16; i++) {
+		out[i][3] = a[indices >> 3 * i & 7];
+	}
+}
+
+// ETC2 blocks are big endian, with texel indices in column order. On top
+// of ETC1's two half blocks, differential colors that overflow select the
+// T, H and planar modes.
+static const int32_t etc_modifiers[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+static const int32_t etc_distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+static const int8_t eac_modifiers[16][8] = {
+	{ -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },  { -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },  { -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },  { -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },   { -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+static uint64_t read64_be(const uint8_t *p) {
+	uint64_t v = 0;
+	for (uint32_t i = 0; i < 8; i++) {
+		v = v << 8 | p[i];
+	}
+	return v;
+}
+
+// `n` bits of `v` ending at bit `hi`
+static uint32_t bits(uint64_t v, uint32_t hi, uint32_t n) {
+	return v >> (hi - n + 1) & ((1u << n) - 1);
+}
+
+static void etc_planar(uint64_t v, uint8_t (*out)[4]) {
+	int32_t o[3] = {
+		extend(bits(v, 62, 6), 6),
+		extend(bits(v, 56, 1) << 6 | bits(v, 54, 6), 7),
+		extend(bits(v, 48, 1) << 5 | bits(v, 44, 2) << 3 | bits(v, 41, 3), 6) };
+	int32_t h[3] = {
+		extend(bits(v, 38, 5) << 1 | bits(v, 32, 1), 6),
+		extend(bits(v, 31, 7), 7),
+		extend(bits(v, 24, 6), 6) };
+	int32_t vv[3] = {
+		extend(bits(v, 18, 6), 6),
+		extend(bits(v, 12, 7), 7),
+		extend(bits(v, 5, 6), 6) };
+
+	for (int32_t y = 0; y < 4; y++) {
+		for (int32_t x = 0; x < 4; x++) {
+			for (uint32_t c = 0; c < 3; c++) {
+				out[y * 4 + x][c] = clamp255((x * (h[c] - o[c]) + y * (vv[c] - o[c]) + 4 * o[c] + 2) >> 2);
+			}
+			out[y * 4 + x][3] = 255;
+		}
+	}
+}
+
+static void decode_etc2(const uint8_t *b, uint8_t (*out)[4]) {
+	uint64_t v = read64_be(b);
+	int32_t base[2][3];
+	int32_t paint[4][3];
+	bool paints = false;
+
+	if (!bits(v, 33, 1)) {
+		for (uint32_t c = 0; c < 3; c++) {
+			base[0][c] = extend(bits(v, 63 - 8 * c, 4), 4);
+			base[1][c] = extend(bits(v, 59 - 8 * c, 4), 4);
+		}
+	}
+	else {
+		int32_t c1[3], c2[3];
+		for (uint32_t c = 0; c < 3; c++) {
+			int32_t d = bits(v, 58 - 8 * c, 3);
+			c1[c] = bits(v, 63 - 8 * c, 5);
+			c2[c] = c1[c] + (d >= 4 ? d - 8 : d);
+		}
+
+		if (c2[0] < 0 || c2[0] > 31) {
+			// T mode
+			int32_t a[3] = {
+				extend(bits(v, 60, 2) << 2 | bits(v, 57, 2), 4),
+				extend(bits(v, 55, 4), 4),
+				extend(bits(v, 51, 4), 4) };
+			int32_t b2[3] = {
+				extend(bits(v, 47, 4), 4),
+				extend(bits(v, 43, 4), 4),
+				extend(bits(v, 39, 4), 4) };
+			int32_t d = etc_distances[bits(v, 35, 2) << 1 | bits(v, 32, 1)];
+			for (uint32_t c = 0; c < 3; c++) {
+				paint[0][c] = a[c];
+				paint[1][c] = b2[c] + d;
+				paint[2][c] = b2[c];
+				paint[3][c] = b2[c] - d;
+			}
+			paints = true;
+		}
+		else if (c2[1] < 0 || c2[1] > 31) {
+			// H mode
+			int32_t a[3] = {
+				extend(bits(v, 62, 4), 4),
+				extend(bits(v, 58, 3) << 1 | bits(v, 52, 1), 4),
+				extend(bits(v, 51, 1) << 3 | bits(v, 49, 3), 4) };
+			int32_t b2[3] = {
+				extend(bits(v, 46, 4), 4),
+				extend(bits(v, 42, 4), 4),
+				extend(bits(v, 38, 4), 4) };
+			uint32_t ca = a[0] << 16 | a[1] << 8 | a[2];
+			uint32_t cb = b2[0] << 16 | b2[1] << 8 | b2[2];
+			int32_t d = etc_distances[bits(v, 34, 1) << 2 | bits(v, 32, 1) << 1 | (ca >= cb)];
+			for (uint32_t c = 0; c < 3; c++) {
+				paint[0][c] = a[c] + d;
+				paint[1][c] = a[c] - d;
+				paint[2][c] = b2[c] + d;
+				paint[3][c] = b2[c] - d;
+			}
+			paints = true;
+		}
+		else if (c2[2] < 0 || c2[2] > 31) {
+			etc_planar(v, out);
+			return;
+		}
+		else {
+			for (uint32_t c = 0; c < 3; c++) {
+				base[0][c] = extend(c1[c], 5);
+				base[1][c] = extend(c2[c], 5);
+			}
+		}
+	}
+
+	uint32_t tables[2] = { bits(v, 39, 3), bits(v, 36, 3) };
+	bool flip = bits(v, 32, 1);
+	for (uint32_t x = 0; x < 4; x++) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t i = x * 4 + y;
+			uint32_t index = (v >> (16 + i) & 1) << 1 | (v >> i & 1);
+			uint8_t *texel = out[y * 4 + x];
+			texel[3] = 255;
+			if (paints) {
+				for (uint32_t c = 0; c < 3; c++) {
+					texel[c] = clamp255(paint[index][c]);
+				}
+				continue;
+			}
+
+			uint32_t half = flip ? y >= 2 : x >= 2;
+			int32_t modifier = etc_modifiers[tables[half]][index & 1];
+			modifier = index & 2 ? -modifier : modifier;
+			for (uint32_t c = 0; c < 3; c++) {
+				texel[c] = clamp255(base[half][c] + modifier);
+			}
+		}
+	}
+}
+
+static void decode_eac_alpha(const uint8_t *b, uint8_t (*out)[4]) {
+	uint64_t v = read64_be(b);
+	int32_t base = b[0];
+	int32_t multiplier = b[1] >> 4;
+	const int8_t *modifiers = eac_modifiers[b[1] & 15];
+	for (uint32_t x = 0; x < 4; x++) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t index = v >> (45 - 3 * (x * 4 + y)) & 7;
+			out[y * 4 + x][3] = clamp255(base + modifiers[index] * multiplier);
+		}
+	}
+}
+
+// BC7 blocks start with a unary mode number, each mode splitting the 128
+// bits differently between partition, endpoints, p-bits and indices.
+typedef struct
+{
+	uint8_t subsets;
+	uint8_t partition_bits;
+	uint8_t rotation_bits;
+	uint8_t selection_bits;
+	uint8_t color_bits;
+	uint8_t alpha_bits;
+	uint8_t endpoint_pbits;
+	uint8_t shared_pbits;
+	uint8_t index_bits;
+	uint8_t index2_bits;
+}
+Bc7Mode;
+
+static const Bc7Mode bc7_modes[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+// Subset of each texel, one bit each for two subsets and two for three
+static const uint16_t bc7_partitions2[64] = {
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+static const uint32_t bc7_partitions3[64] = {
+	0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050,
+	0x5555A0A0, 0x5A5A5050, 0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090,
+	0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250, 0xA5945040, 0x0A425054,
+	0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+	0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414,
+	0x50A4A450, 0x6A5A0200, 0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424,
+	0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50, 0x500AA550, 0xAAAA4444,
+	0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+	0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580,
+	0xAA141414, 0x96960000, 0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000,
+	0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+};
+
+// Texels whose index is one bit shorter, besides texel 0: the anchor of
+// the second subset, and of the second and third ones for three subsets
+static const uint8_t bc7_anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+static const uint8_t bc7_anchors3[2][64] = {
+	{
+		 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+		 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+		 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+		 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+	},
+	{
+		15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+		15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+		15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+		15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+	},
+};
+
+static const uint8_t bc7_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static uint32_t read_bits(const uint8_t *b, uint32_t *pos, uint32_t n) {
+	uint32_t v = 0;
+	for (uint32_t i = 0; i < n; i++, (*pos)++) {
+		v |= (b[*pos >> 3] >> (*pos & 7) & 1) << i;
+	}
+	return v;
+}
+
+static uint8_t bc7_weight(uint32_t bits, uint32_t index) {
+	return bits == 2 ? bc7_weights2[index] : bits == 3 ? bc7_weights3[index] : bc7_weights4[index];
+}
+
+static void decode_bc7(const uint8_t *b, uint8_t (*out)[4]) {
+	uint32_t mode = 0;
+	while (mode < 8 && !(b[0] >> mode & 1)) {
+		mode++;
+	}
+	if (mode == 8) {
+		memset(out, 0, 16 * 4);
+		return;
+	}
+
+	const Bc7Mode *m = &bc7_modes[mode];
+	uint32_t pos = mode + 1;
+	uint32_t partition = read_bits(b, &pos, m->partition_bits);
+	uint32_t rotation = read_bits(b, &pos, m->rotation_bits);
+	uint32_t selection = read_bits(b, &pos, m->selection_bits);
+
+	uint32_t ends[6][4];
+	uint32_t count = m->subsets * 2;
+	for (uint32_t c = 0; c < 3; c++) {
+		for (uint32_t e = 0; e < count; e++) {
+			ends[e][c] = read_bits(b, &pos, m->color_bits);
+		}
+	}
+	for (uint32_t e = 0; e < count; e++) {
+		ends[e][3] = read_bits(b, &pos, m->alpha_bits);
+	}
+
+	uint32_t color_bits = m->color_bits;
+	uint32_t alpha_bits = m->alpha_bits;
+	if (m->endpoint_pbits || m->shared_pbits) {
+		uint32_t p = 0;
+		for (uint32_t e = 0; e < count; e++) {
+			if (m->endpoint_pbits || e % 2 == 0) {
+				p = read_bits(b, &pos, 1);
+			}
+			for (uint32_t c = 0; c < 4; c++) {
+				ends[e][c] = ends[e][c] << 1 | p;
+			}
+		}
+		color_bits++;
+		alpha_bits += alpha_bits ? 1 : 0;
+	}
+	for (uint32_t e = 0; e < count; e++) {
+		for (uint32_t c = 0; c < 3; c++) {
+			ends[e][c] = extend(ends[e][c], color_bits);
+		}
+		ends[e][3] = alpha_bits ? extend(ends[e][3], alpha_bits) : 255;
+	}
+
+	uint32_t subsets[16];
+	uint32_t anchors[2] = { 0, 0 };
+	for (uint32_t i = 0; i < 16; i++) {
+		subsets[i] =
+			m->subsets == 2 ? bc7_partitions2[partition] >> i & 1 :
+			m->subsets == 3 ? bc7_partitions3[partition] >> 2 * i & 3 : 0;
+	}
+	if (m->subsets == 2) {
+		anchors[0] = bc7_anchors2[partition];
+	}
+	else if (m->subsets == 3) {
+		anchors[0] = bc7_anchors3[0][partition];
+		anchors[1] = bc7_anchors3[1][partition];
+	}
+
+	uint32_t indices[16], indices2[16];
+	for (uint32_t i = 0; i < 16; i++) {
+		bool anchor = i == 0 || (m->subsets > 1 && i == anchors[0]) || (m->subsets > 2 && i == anchors[1]);
+		indices[i] = read_bits(b, &pos, m->index_bits - anchor);
+	}
+	for (uint32_t i = 0; i < 16 && m->index2_bits; i++) {
+		indices2[i] = read_bits(b, &pos, m->index2_bits - (i == 0));
+	}
+
+	for (uint32_t i = 0; i < 16; i++) {
+		const uint32_t *e0 = ends[subsets[i] * 2];
+		const uint32_t *e1 = ends[subsets[i] * 2 + 1];
+		uint32_t w = bc7_weight(m->index_bits, indices[i]);
+		uint32_t wa = w;
+		if (m->index2_bits) {
+			uint32_t w2 = bc7_weight(m->index2_bits, indices2[i]);
+			w = selection ? w2 : w;
+			wa = selection ? wa : w2;
+		}
+		for (uint32_t c = 0; c < 4; c++) {
+			uint32_t weight = c == 3 ? wa : w;
+			out[i][c] = ((64 - weight) * e0[c] + weight * e1[c] + 32) >> 6;
+		}
+		if (rotation) {
+			uint8_t t = out[i][3];
+			out[i][3] = out[i][rotation - 1];
+			out[i][rotation - 1] = t;
+		}
+	}
+}
+
+void texfile_decode(const TexFile *t, uint32_t level, uint8_t *pixels) {
+	int32_t w = t->width >> level;
+	int32_t h = t->height >> level;
+	w = w > 0 ? w : 1;
+	h = h > 0 ? h : 1;
+
+	const uint8_t *b = t->levels[level].data;
+	uint32_t block_size = texfile_block_size(t->format);
+	uint8_t texels[16][4];
+	for (int32_t by = 0; by < h; by += 4) {
+		for (int32_t bx = 0; bx < w; bx += 4, b += block_size) {
+			switch (t->format) {
+				case TEXFILE_BC1:
+					decode_bc1(b, texels, false);
+					break;
+				case TEXFILE_BC3:
+					decode_bc1(b + 8, texels, true);
+					decode_bc3_alpha(b, texels);
+					break;
+				case TEXFILE_BC7:
+					decode_bc7(b, texels);
+					break;
+				case TEXFILE_ETC2_RGB:
+					decode_etc2(b, texels);
+					break;
+				default:
+					decode_etc2(b + 8, texels);
+					decode_eac_alpha(b, texels);
+					break;
+			}
+
+			for (int32_t y = 0; y < 4 && by + y < h; y++) {
+				for (int32_t x = 0; x < 4 && bx + x < w; x++) {
+					memcpy(pixels + ((size_t)(by + y) * w + bx + x) * 4, texels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
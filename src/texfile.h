@@ -0,0 +1,55 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_TEXFILE_H
+#define NEKO_TEXFILE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TEXFILE_MAX_LEVELS 16
+
+// Block compressed formats, all of them made of 4x4 texel blocks. sRGB
+// variants are read as their linear twins and BC1 always keeps its 1 bit
+// alpha.
+typedef enum
+{
+	TEXFILE_BC1,
+	TEXFILE_BC3,
+	TEXFILE_BC7,
+	TEXFILE_ETC2_RGB,
+	TEXFILE_ETC2_RGBA,
+	TEXFILE_FORMATS,
+}
+TexFormat;
+
+typedef struct
+{
+	const uint8_t *data;
+	uint32_t       size;
+}
+TexLevel;
+
+// A DDS or KTX2 file parsed in place, levels point into the file data and
+// go from the full size image down. Only the first face or array layer
+// is read. No GL in here, this only knows about the containers and blocks.
+typedef struct
+{
+	TexFormat format;
+	int32_t   width;
+	int32_t   height;
+	uint32_t  level_count;
+	TexLevel  levels[TEXFILE_MAX_LEVELS];
+}
+TexFile;
+
+// Returns false when `data` isn't a DDS or KTX2 file in one of the
+// formats above, or when it is cut short
+bool     texfile_parse(TexFile *t, const uint8_t *data, size_t size);
+uint32_t texfile_block_size(TexFormat format);
+// Expands `level` into RGBA8 pixels, for drivers without the format
+void     texfile_decode(const TexFile *t, uint32_t level, uint8_t *pixels);
+
+#endif
@@ -0,0 +1,39 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+
+void timing_push(TimingSeries *s, float ms) {
+	s->samples[s->count++ % TIMING_WINDOW] = ms;
+}
+
+static int compare_floats(const void *a, const void *b) {
+	float x = *(const float *)a;
+	float y = *(const float *)b;
+	return (x > y) - (x < y);
+}
+
+// Nearest rank, the smallest sample with `percent` of them at or below it
+static float percentile(const float *sorted, uint32_t n, uint32_t percent) {
+	return sorted[(n * percent + 99) / 100 - 1];
+}
+
+Timing timing_summary(const TimingSeries *s) {
+	uint32_t n = s->count < TIMING_WINDOW ? s->count : TIMING_WINDOW;
+	Timing t = { .samples = n };
+	if (n == 0) {
+		return t;
+	}
+	float sorted[TIMING_WINDOW];
+	memcpy(sorted, s->samples, n * sizeof(float));
+	qsort(sorted, n, sizeof(float), compare_floats);
+	t.last = s->samples[(s->count - 1) % TIMING_WINDOW];
+	t.p50 = percentile(sorted, n, 50);
+	t.p95 = percentile(sorted, n, 95);
+	t.p99 = percentile(sorted, n, 99);
+	return t;
+}
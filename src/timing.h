@@ -0,0 +1,26 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_TIMING_H
+#define NEKO_TIMING_H
+
+#include <inttypes.h>
+#include "renderer.h"
+
+// Samples the percentiles are taken over, older ones fall out
+#define TIMING_WINDOW 240
+
+// Rolling window of durations in milliseconds. No GL in here, the
+// renderers feed it from the clock and from timer queries.
+typedef struct
+{
+	float    samples[TIMING_WINDOW];
+	uint32_t count;
+}
+TimingSeries;
+
+void   timing_push(TimingSeries *s, float ms);
+Timing timing_summary(const TimingSeries *s);
+
+#endif
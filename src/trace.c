@@ -0,0 +1,129 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifdef NEKO_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "system.h"
+#include "trace.h"
+
+#define TRACE_THREADS 64
+#define TRACE_EVENTS  (1 << 16)
+#define TRACE_DEPTH   64
+
+typedef struct
+{
+	const char *name;
+	double      start;
+	double      end;
+}
+TraceEvent;
+
+// Only its thread writes to a buffer. `count` is stored after the event
+// it counts, so the dump never reads an event being written unless the
+// ring wrapped around onto it.
+typedef struct
+{
+	const char *name;
+	uint32_t    count;
+	uint32_t    depth;
+	TraceEvent  open[TRACE_DEPTH];
+	TraceEvent  events[TRACE_EVENTS];
+}
+TraceBuffer;
+
+static TraceBuffer *buffers[TRACE_THREADS];
+static uint32_t     buffer_count;
+static __thread TraceBuffer *local;
+
+static TraceBuffer *thread_buffer(void) {
+	if (!local) {
+		local = calloc(1, sizeof(TraceBuffer));
+		// Threads past the limit record into a buffer nobody dumps
+		uint32_t slot = __atomic_fetch_add(&buffer_count, 1, __ATOMIC_RELAXED);
+		if (slot < TRACE_THREADS) {
+			__atomic_store_n(&buffers[slot], local, __ATOMIC_RELEASE);
+		}
+	}
+	return local;
+}
+
+void trace_begin(const char *name) {
+	TraceBuffer *b = thread_buffer();
+	if (b->depth < TRACE_DEPTH) {
+		b->open[b->depth] = (TraceEvent){ name, system_time(), 0.0 };
+	}
+	b->depth++;
+}
+
+void trace_end() {
+	double now = system_time();
+	TraceBuffer *b = thread_buffer();
+	assert(b->depth > 0 && "TRACE_END without TRACE_BEGIN");
+	if (--b->depth >= TRACE_DEPTH) {
+		return;
+	}
+	TraceEvent *e = &b->events[b->count % TRACE_EVENTS];
+	*e = b->open[b->depth];
+	e->end = now;
+	__atomic_store_n(&b->count, b->count + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread(const char *name) {
+	thread_buffer()->name = name;
+}
+
+void trace_dump(const char *filename) {
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		fprintf(stderr, "Error: couldn't create %s\n", filename);
+		return;
+	}
+
+	uint32_t threads = __atomic_load_n(&buffer_count, __ATOMIC_RELAXED);
+	threads = threads < TRACE_THREADS ? threads : TRACE_THREADS;
+	// Times start at the first zone still recorded
+	double origin = 0.0;
+	for (uint32_t t = 0; t < threads; t++) {
+		TraceBuffer *b = __atomic_load_n(&buffers[t], __ATOMIC_ACQUIRE);
+		uint32_t count = b ? __atomic_load_n(&b->count, __ATOMIC_ACQUIRE) : 0;
+		uint32_t first = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+		for (uint32_t i = first; i < count; i++) {
+			double start = b->events[i % TRACE_EVENTS].start;
+			origin = origin == 0.0 || start < origin ? start : origin;
+		}
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	const char *separator = "";
+	for (uint32_t t = 0; t < threads; t++) {
+		TraceBuffer *b = __atomic_load_n(&buffers[t], __ATOMIC_ACQUIRE);
+		if (!b) {
+			continue;
+		}
+		if (b->name) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				separator, t, b->name);
+			separator = ",\n";
+		}
+		uint32_t count = __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+		uint32_t first = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+		for (uint32_t i = first; i < count; i++) {
+			const TraceEvent *e = &b->events[i % TRACE_EVENTS];
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				separator, e->name, t, (e->start - origin) * 1e6, (e->end - e->start) * 1e6);
+			separator = ",\n";
+		}
+	}
+	fprintf(file, "\n]}\n");
+	bool failed = ferror(file);
+	if (fclose(file) != 0 || failed) {
+		fprintf(stderr, "Error: couldn't write %s\n", filename);
+	}
+}
+
+#endif
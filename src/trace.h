@@ -0,0 +1,39 @@
+// Copyright 2025 Elloramir.
+// Use of this source code is governed by a MIT
+// license that can be found in the LICENSE file.
+
+#ifndef NEKO_TRACE_H
+#define NEKO_TRACE_H
+
+// Profiling zones, built in with `make OPTS=-DNEKO_TRACE` and empty
+// otherwise. TRACE_DUMP writes what was recorded as Chrome trace JSON,
+// which chrome://tracing and ui.perfetto.dev open:
+//   TRACE_BEGIN("update");
+//   ...
+//   TRACE_END();
+//   TRACE_DUMP("trace.json");
+// Zones nest and end on the thread they began on, names are string
+// literals. Each thread records into a ring of its own without locking,
+// once full the oldest zones make room for new ones.
+
+#ifdef NEKO_TRACE
+#define TRACE_BEGIN(name)  trace_begin(name)
+#define TRACE_END()        trace_end()
+#define TRACE_THREAD(name) trace_thread(name)
+#define TRACE_DUMP(file)   trace_dump(file)
+#else
+#define TRACE_BEGIN(name)  ((void)0)
+#define TRACE_END()        ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_DUMP(file)   ((void)0)
+#endif
+
+void trace_begin(const char *name);
+void trace_end();
+// Names the calling thread in the trace, threads are numbered otherwise
+void trace_thread(const char *name);
+// Other threads may keep recording, the zones they write meanwhile may
+// or may not make it
+void trace_dump(const char *filename);
+
+#endif
@@ -3,12 +3,17 @@
 // license that can be found in the LICENSE file.
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 
 #include "system.h"
 #include "opengl.h"
+#include "trace.h"
 
 #define X(type, name) type name;
 GL_FUNCTIONS(X)
+GL_OPTIONAL_FUNCTIONS(X)
 #undef X
 
 static struct
@@ -17,6 +22,11 @@ static struct
 	HWND      win_handler;
 	HDC       device_ctx;
 	HGLRC     gl_ctx;
+	bool      damaged;
+	// Set by system_set_framebuffer, shown through `bgra`
+	const uint8_t *framebuffer;
+	int32_t        fb_width, fb_height;
+	uint8_t       *bgra;
 }
 self = { 0 };
 
@@ -66,6 +76,15 @@ static LRESULT CALLBACK win_proc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lpara
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		return 0;
+	// The window lost what it showed, frames that didn't change still have
+	// to be drawn again
+	case WM_PAINT:
+		ValidateRect(wnd, NULL);
+		self.damaged = true;
+		return 0;
+	case WM_SIZE:
+		self.damaged = true;
+		break;
 	}
 
 	return DefWindowProcW(wnd, msg, wparam, lparam);
@@ -220,6 +239,9 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
 #define X(type, name) name = (type)wglGetProcAddress(#name); assert(name);
 		GL_FUNCTIONS(X)
 #undef X
+#define X(type, name) name = (type)wglGetProcAddress(#name);
+		GL_OPTIONAL_FUNCTIONS(X)
+#undef X
 
 #ifdef GL_DEBUG
 		// Enable debug callback
@@ -234,16 +256,19 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
 }
 
 bool system_window_should_close() {
+	TRACE_BEGIN("system_window_should_close");
 	MSG msg;
+	bool quit = false;
 	if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
-		if (msg.message == WM_QUIT) {
-			return true;
+		quit = msg.message == WM_QUIT;
+		if (!quit) {
+			TranslateMessage(&msg);
+			DispatchMessageW(&msg);
 		}
-		TranslateMessage(&msg);
-		DispatchMessageW(&msg);
 	}
+	TRACE_END();
 
-	return false;
+	return quit;
 }
 
 vec2 system_window_size() {
@@ -260,17 +285,60 @@ bool system_window_is_visible() {
 	return size.x != 0 && size.y != 0;
 }
 
+bool system_window_damaged() {
+	bool damaged = self.damaged;
+	self.damaged = false;
+	return damaged;
+}
+
 void system_swap_buffers() {
+	TRACE_BEGIN("system_swap_buffers");
+	if (self.framebuffer) {
+		int32_t w = self.fb_width;
+		int32_t h = self.fb_height;
+		for (int32_t i = 0; i < w * h; i++) {
+			self.bgra[i * 4 + 0] = self.framebuffer[i * 4 + 2];
+			self.bgra[i * 4 + 1] = self.framebuffer[i * 4 + 1];
+			self.bgra[i * 4 + 2] = self.framebuffer[i * 4 + 0];
+			self.bgra[i * 4 + 3] = 255;
+		}
+		// A negative height makes the bitmap top down
+		BITMAPINFO info = { .bmiHeader = {
+			.biSize = sizeof(BITMAPINFOHEADER), .biWidth = w, .biHeight = -h,
+			.biPlanes = 1, .biBitCount = 32, .biCompression = BI_RGB } };
+		SetDIBitsToDevice(self.device_ctx, 0, 0, w, h, 0, 0, 0, h, self.bgra, &info, DIB_RGB_COLORS);
+		TRACE_END();
+		return;
+	}
 	if (!SwapBuffers(self.device_ctx)) {
 		system_panic("Failed to swap OpenGL buffers!");
 	}
+	TRACE_END();
+}
+
+void system_set_framebuffer(const uint8_t *pixels, int32_t width, int32_t height) {
+	if (pixels && (width != self.fb_width || height != self.fb_height || !self.bgra)) {
+		free(self.bgra);
+		self.bgra = malloc((size_t)width * height * 4);
+	}
+	self.framebuffer = pixels;
+	self.fb_width = width;
+	self.fb_height = height;
 }
 
 void system_sleep(uint32_t miliseconds) {
 	Sleep(miliseconds);
 }
 
-void *system_load_file(const char *filename) {
+// Seconds from a monotonic clock, only differences are meaningful
+double system_time() {
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+}
+
+void *system_load_file(const char *filename, size_t *size) {
 	HANDLE file = CreateFileA(
 		filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (file == INVALID_HANDLE_VALUE) {
@@ -283,7 +351,7 @@ void *system_load_file(const char *filename) {
 		return NULL;
 	}
 
-	void *data = malloc(file_size.QuadPart);
+	char *data = malloc(file_size.QuadPart + 1);
 	if (!data) {
 		CloseHandle(file);
 		return NULL;
@@ -297,9 +365,114 @@ void *system_load_file(const char *filename) {
 	}
 
 	CloseHandle(file);
+	data[file_size.QuadPart] = '\0';
+	if (size) {
+		*size = file_size.QuadPart;
+	}
+	return data;
+}
+
+const void *system_map_file(const char *filename, size_t *size) {
+	HANDLE file = CreateFileA(
+		filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	LARGE_INTEGER file_size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(file);
+	if (!mapping) {
+		return NULL;
+	}
+
+	// The view keeps the mapping alive
+	const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data) {
+		*size = file_size.QuadPart;
+	}
 	return data;
 }
 
+// A neko folder in %LOCALAPPDATA%
+const char *system_cache_dir() {
+	static char dir[MAX_PATH];
+	if (dir[0]) {
+		return dir;
+	}
+	const char *local = getenv("LOCALAPPDATA");
+	int n = local && local[0] ? snprintf(dir, sizeof(dir), "%s\\neko\\", local) : 0;
+	if (n <= 0 || n >= (int)sizeof(dir)
+			|| (!CreateDirectoryA(dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)) {
+		dir[0] = '\0';
+	}
+	return dir;
+}
+
+bool system_replace_file(const char *from, const char *to) {
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+uint32_t system_cpu_count() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+typedef struct
+{
+	void (*entry)(void *arg);
+	void *arg;
+}
+ThreadStart;
+
+static DWORD WINAPI thread_main(LPVOID start) {
+	ThreadStart s = *(ThreadStart *)start;
+	free(start);
+	s.entry(s.arg);
+	return 0;
+}
+
+void system_create_thread(void (*entry)(void *arg), void *arg) {
+	ThreadStart *start = malloc(sizeof(ThreadStart));
+	*start = (ThreadStart){ entry, arg };
+	HANDLE thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+	if (!thread) {
+		system_panic("Couldn't create thread");
+	}
+	CloseHandle(thread);
+}
+
+void *system_create_mutex() {
+	CRITICAL_SECTION *mutex = malloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection(mutex);
+	return mutex;
+}
+
+void system_lock(void *mutex) {
+	EnterCriticalSection(mutex);
+}
+
+void system_unlock(void *mutex) {
+	LeaveCriticalSection(mutex);
+}
+
+void *system_create_semaphore() {
+	return CreateSemaphoreA(NULL, 0, LONG_MAX, NULL);
+}
+
+void system_post(void *semaphore) {
+	ReleaseSemaphore(semaphore, 1, NULL);
+}
+
+void system_wait(void *semaphore) {
+	WaitForSingleObject(semaphore, INFINITE);
+}
+
 void system_close_window() {
 	DestroyWindow(self.win_handler);
 	self.win_handler = NULL;
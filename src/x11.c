@@ -6,19 +6,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysym.h>
-#include <GL/gl.h>
-#include <GL/glx.h>
 
 #include "system.h"
 #include "opengl.h"
+#include "posix.h"
+#include "trace.h"
 
 #define X(type, name) type name;
 GL_FUNCTIONS(X)
+GL_OPTIONAL_FUNCTIONS(X)
 #undef X
 
 static struct {
@@ -30,34 +29,14 @@ static struct {
     Colormap colormap;
     Atom wm_delete_window;
     bool should_close;
+    bool damaged;
     int width, height;
+    // Set by system_set_framebuffer, converted into `image` to be shown
+    const uint8_t *framebuffer;
+    XImage *image;
 } self = {0};
 
-// Display an error message and exit
-void system_panic(const char* message) {
-    fprintf(stderr, "Error: %s\n", message);
-    exit(1);
-}
-
-#ifdef GL_DEBUG
-// OpenGL debug callback for X11
-static void debug_callback(
-    GLenum source, GLenum type, GLuint id, GLenum severity,
-    GLsizei length, const GLchar* message, const void* user)
-{
-    (void)source;
-    (void)type;
-    (void)id;
-    (void)length;
-    (void)user;
-
-    fprintf(stderr, "OpenGL Debug: %s\n", message);
-    if (severity == GL_DEBUG_SEVERITY_HIGH || severity == GL_DEBUG_SEVERITY_MEDIUM) {
-        system_panic(message);
-    }
-}
-#endif
-
+#ifndef NEKO_SOFT
 // Load OpenGL functions using glXGetProcAddress
 static void load_gl_functions(void) {
 #define X(type, name) \
@@ -69,14 +48,19 @@ static void load_gl_functions(void) {
     GL_FUNCTIONS(X)
 #undef X
 
+#define X(type, name) name = (type)glXGetProcAddress((const GLubyte*)#name);
+    GL_OPTIONAL_FUNCTIONS(X)
+#undef X
+
 #ifdef GL_DEBUG
     // Enable debug callback if available
     if (glDebugMessageCallback) {
-        glDebugMessageCallback(&debug_callback, NULL);
+        glDebugMessageCallback(&posix_debug_callback, NULL);
         glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
     }
 #endif
 }
+#endif
 
 void system_create_window(int32_t width, int32_t height, const char *name) {
     assert(self.display == NULL && "Window already created");
@@ -91,6 +75,14 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
     self.width = width;
     self.height = height;
 
+#ifdef NEKO_SOFT
+    // The software renderer only puts images on the window, there is no GL
+    // context and any TrueColor visual with 32 bit pixels takes them
+    XVisualInfo visual_template = { .screen = self.screen, .depth = 24, .class = TrueColor };
+    int visual_count = 0;
+    self.visual_info = XGetVisualInfo(self.display,
+        VisualScreenMask | VisualDepthMask | VisualClassMask, &visual_template, &visual_count);
+#else
     // GLX attributes for modern OpenGL context
     int glx_attribs[] = {
         GLX_X_RENDERABLE,    True,
@@ -140,6 +132,7 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
 
     // Get visual info from the selected framebuffer config
     self.visual_info = glXGetVisualFromFBConfig(self.display, bestFbc);
+#endif
     if (!self.visual_info) {
         system_panic("Failed to get XVisualInfo");
     }
@@ -182,6 +175,7 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
     self.wm_delete_window = XInternAtom(self.display, "WM_DELETE_WINDOW", False);
     XSetWMProtocols(self.display, self.window, &self.wm_delete_window, 1);
 
+#ifndef NEKO_SOFT
     // Create OpenGL context
     // First check if we can create a modern context
     typedef GLXContext (*glXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
@@ -221,10 +215,12 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
 
     // Load OpenGL functions
     load_gl_functions();
+#endif
 
     // Show window
     XMapWindow(self.display, self.window);
 
+#ifndef NEKO_SOFT
     // Enable VSync if available
     typedef int (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
     glXSwapIntervalEXTProc glXSwapIntervalEXT = 
@@ -232,6 +228,7 @@ void system_create_window(int32_t width, int32_t height, const char *name) {
     if (glXSwapIntervalEXT) {
         glXSwapIntervalEXT(self.display, self.window, 1);
     }
+#endif
 
     XFlush(self.display);
     self.should_close = false;
@@ -241,6 +238,7 @@ bool system_window_should_close() {
     if (!self.display) return true;
 
     // Process pending X11 events
+    TRACE_BEGIN("system_window_should_close");
     while (XPending(self.display)) {
         XEvent event;
         XNextEvent(self.display, &event);
@@ -256,11 +254,18 @@ bool system_window_should_close() {
                 self.width = event.xconfigure.width;
                 self.height = event.xconfigure.height;
                 break;
+            case Expose:
+                // What the window showed is gone, even if the scene didn't change
+                if (event.xexpose.count == 0) {
+                    self.damaged = true;
+                }
+                break;
             case DestroyNotify:
                 self.should_close = true;
                 break;
         }
     }
+    TRACE_END();
 
     return self.should_close;
 }
@@ -273,58 +278,77 @@ bool system_window_is_visible() {
     return self.width > 0 && self.height > 0 && !self.should_close;
 }
 
-void system_swap_buffers() {
-    if (self.display && self.window) {
-        glXSwapBuffers(self.display, self.window);
-    }
+bool system_window_damaged() {
+    bool damaged = self.damaged;
+    self.damaged = false;
+    return damaged;
 }
 
-void system_sleep(uint32_t milliseconds) {
-    usleep(milliseconds * 1000);
+// Position of the lowest bit of a visual color mask
+static int mask_shift(unsigned long mask) {
+    int shift = 0;
+    while (mask && !(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    return shift;
 }
 
-void *system_load_file(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        return NULL;
+void system_swap_buffers() {
+    if (!self.display || !self.window) {
+        return;
     }
-
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    if (size <= 0) {
-        fclose(file);
-        return NULL;
+    TRACE_BEGIN("system_swap_buffers");
+    if (!self.framebuffer) {
+#ifndef NEKO_SOFT
+        glXSwapBuffers(self.display, self.window);
+#endif
+        TRACE_END();
+        return;
     }
 
-    // Allocate memory and read file
-    void *data = malloc(size + 1); // +1 for null terminator if needed
-    if (!data) {
-        fclose(file);
-        return NULL;
+    // Pixels go out in whatever layout the visual has, with 32 bits each
+    XImage *image = self.image;
+    Visual *visual = self.visual_info->visual;
+    int r = mask_shift(visual->red_mask);
+    int g = mask_shift(visual->green_mask);
+    int b = mask_shift(visual->blue_mask);
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *src = self.framebuffer + (size_t)y * image->width * 4;
+        uint32_t *dst = (uint32_t *)(image->data + (size_t)y * image->bytes_per_line);
+        for (int x = 0; x < image->width; x++, src += 4) {
+            dst[x] = (uint32_t)src[0] << r | (uint32_t)src[1] << g | (uint32_t)src[2] << b;
+        }
     }
+    XPutImage(self.display, self.window, DefaultGC(self.display, self.screen), image,
+        0, 0, 0, 0, image->width, image->height);
+    XFlush(self.display);
+    TRACE_END();
+}
 
-    size_t read_size = fread(data, 1, size, file);
-    fclose(file);
-
-    if (read_size != (size_t)size) {
-        free(data);
-        return NULL;
+void system_set_framebuffer(const uint8_t *pixels, int32_t width, int32_t height) {
+    if (pixels && (!self.image || self.image->width != width || self.image->height != height)) {
+        if (self.image) {
+            XDestroyImage(self.image);
+        }
+        char *data = malloc((size_t)width * height * 4);
+        self.image = XCreateImage(self.display, self.visual_info->visual, self.visual_info->depth,
+            ZPixmap, 0, data, width, height, 32, 0);
+        if (!self.image) {
+            system_panic("Failed to create the framebuffer image");
+        }
     }
-
-    // Add null terminator for text files
-    ((char*)data)[size] = '\0';
-    return data;
+    self.framebuffer = pixels;
 }
 
 void system_close_window() {
+#ifndef NEKO_SOFT
     if (self.gl_context) {
         glXMakeCurrent(self.display, None, NULL);
         glXDestroyContext(self.display, self.gl_context);
         self.gl_context = NULL;
     }
+#endif
 
     if (self.window) {
         XDestroyWindow(self.display, self.window);
@@ -336,6 +360,11 @@ void system_close_window() {
         self.colormap = 0;
     }
 
+    if (self.image) {
+        XDestroyImage(self.image);
+        self.image = NULL;
+    }
+
     if (self.visual_info) {
         XFree(self.visual_info);
         self.visual_info = NULL;
@@ -348,13 +377,3 @@ void system_close_window() {
 
     self.should_close = true;
 }
-
-// Entry point defined by the user
-int32_t entry_point(void);
-
-int main(int argc, char *argv[]) {
-    (void)argc;
-    (void)argv;
-    
-    return entry_point();
-}
\ No newline at end of file